@@ -1,6 +1,27 @@
 #! /bin/sh
-BIN_DIR=$HOME/repo/chip8emu/bin/
-SRC_DIR=$HOME/repo/chip8emu/chip8emu/src
+BIN_DIR=${BIN_DIR:-$HOME/repo/chip8emu/bin/}
+SRC_DIR=${SRC_DIR:-$HOME/repo/chip8emu/chip8emu/src}
 EXE_NAME=chip8emu
+LIB_NAME=libchip8.a
+CFLAGS="-std=c99 -O2 $EXTRA_CFLAGS" # EXTRA_CFLAGS=-DCHIP8_PROFILE enables profiling
 
-gcc -std=c99 -o $BIN_DIR$EXE_NAME $SRC_DIR/chip8emu.c -lncurses
+# emulator core and front ends as a static library for embedding
+LIB_SRCS="chip8.c decode.c disasm.c frontend_null.c frontend_ncurses.c pool.c batch.c jit.c sched.c audio.c trace.c savestate.c rewind.c replay.c profile.c cfg.c lockstep.c stream.c"
+OBJS=""
+for src in $LIB_SRCS
+do
+    obj=$BIN_DIR${src%.c}.o
+    gcc $CFLAGS -c -o $obj $SRC_DIR/$src || exit 1
+    OBJS="$OBJS $obj"
+done
+rm -f $BIN_DIR$LIB_NAME
+ar rcs $BIN_DIR$LIB_NAME $OBJS || exit 1
+
+# command line emulator
+gcc $CFLAGS -o $BIN_DIR$EXE_NAME $SRC_DIR/chip8emu.c $BIN_DIR$LIB_NAME -lncurses -pthread -lm
+
+# throughput suite over synthetic ROMs
+gcc $CFLAGS -o ${BIN_DIR}chip8bench $SRC_DIR/bench.c $BIN_DIR$LIB_NAME -pthread -lm
+
+# coverage guided fuzzer over ROM bytes and key input
+gcc $CFLAGS -o ${BIN_DIR}chip8fuzz $SRC_DIR/fuzz.c $BIN_DIR$LIB_NAME -pthread
@@ -0,0 +1,329 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "audio.h"
+
+#define RUN_TONE 0x80000000u // run entry: tone bit and frame count
+#define RUN_MAX 0x7FFFFFFFu
+#define SYNTH_CHUNK 2048 // samples per sink write
+
+struct chip8_audio
+{
+    uint32_t ring[AUDIO_RING];
+    // head and tail on their own cache lines, each only written by one side
+    char pad0[64];
+    unsigned int head; // next slot the emulation thread fills
+    char pad1[64];
+    unsigned int tail; // next slot the audio thread reads
+    char pad2[64];
+    int closing;
+
+    // emulation thread
+    uint32_t runTone;
+    uint32_t runFrames;
+    uint32_t runLimit; // frames before the run is handed over, doubled while the ring is full
+    long long frames;
+    long long toneFrames;
+    long long dropped;
+
+    // audio thread
+    audio_sink* sink;
+    int rate;
+    int toneHz;
+    long long frame; // frames synthesized
+    long long phase; // samples synthesized
+    int lastTone;
+    pthread_t thread;
+};
+
+static int pushRun(chip8_audio* audio)
+{
+    unsigned int head = audio->head;
+    if (head - __atomic_load_n(&audio->tail, __ATOMIC_ACQUIRE) == AUDIO_RING)
+        return 0;
+    audio->ring[head & (AUDIO_RING-1)] = audio->runTone | audio->runFrames;
+    __atomic_store_n(&audio->head, head + 1, __ATOMIC_RELEASE);
+    audio->runFrames = 0;
+    audio->runLimit = AUDIO_RUN_FRAMES;
+    return 1;
+}
+
+void audioFrame(chip8_audio* audio, int tone)
+{
+    uint32_t bit = tone ? RUN_TONE : 0;
+    if (audio->runFrames && (bit != audio->runTone || audio->runFrames >= audio->runLimit))
+    {
+        if (!pushRun(audio))
+        {
+            if (bit != audio->runTone || audio->runFrames == RUN_MAX)
+            {
+                // the audio thread is a whole ring behind, lose the run rather than wait
+                audio->dropped += audio->runFrames;
+                audio->runFrames = 0;
+            }
+            else if (audio->runLimit <= RUN_MAX / 2)
+                audio->runLimit *= 2; // keep growing the run, try again later
+            else
+                audio->runLimit = RUN_MAX;
+        }
+    }
+    audio->runTone = bit;
+    audio->runFrames++;
+    audio->frames++;
+    audio->toneFrames += tone != 0;
+}
+
+// square wave for a run of frames, 1/60s of samples each with the fraction carried over
+static void synthesize(chip8_audio* audio, int tone, long long frames)
+{
+    int16_t samples[SYNTH_CHUNK];
+    long long count = (audio->frame + frames) * audio->rate / 60 - audio->frame * audio->rate / 60;
+    audio->frame += frames;
+    while (count > 0)
+    {
+        int n = count < SYNTH_CHUNK ? (int) count : SYNTH_CHUNK;
+        for (int i = 0; i < n; i++)
+        {
+            long long halfPeriods = (audio->phase + i) * 2 * audio->toneHz / audio->rate;
+            samples[i] = !tone ? 0 : (halfPeriods & 1) ? -AUDIO_AMPLITUDE : AUDIO_AMPLITUDE;
+        }
+        audio->sink->write(audio->sink, samples, n);
+        audio->phase += n;
+        count -= n;
+    }
+}
+
+static void* audioThread(void* arg)
+{
+    chip8_audio* audio = arg;
+    struct timespec idle = { 0, 1000000 };
+    for (;;)
+    {
+        // closing is set after the last run, so an empty ring after seeing it is final
+        int closing = __atomic_load_n(&audio->closing, __ATOMIC_ACQUIRE);
+        unsigned int head = __atomic_load_n(&audio->head, __ATOMIC_ACQUIRE);
+        if (audio->tail == head)
+        {
+            if (closing)
+                break;
+            nanosleep(&idle, NULL);
+            continue;
+        }
+        while (audio->tail != head)
+        {
+            uint32_t run = audio->ring[audio->tail & (AUDIO_RING-1)];
+            __atomic_store_n(&audio->tail, audio->tail + 1, __ATOMIC_RELEASE);
+            int tone = (run & RUN_TONE) != 0;
+            if (tone && !audio->lastTone)
+                audio->sink->start(audio->sink);
+            audio->lastTone = tone;
+            synthesize(audio, tone, run & RUN_MAX);
+        }
+    }
+    return NULL;
+}
+
+chip8_audio* audioCreate(audio_sink* sink, int rate, int toneHz)
+{
+    chip8_audio* audio = calloc(1, sizeof(chip8_audio));
+    if (audio == NULL)
+    {
+        sink->close(sink);
+        return NULL;
+    }
+    audio->sink = sink;
+    audio->rate = rate;
+    audio->toneHz = toneHz;
+    audio->runLimit = AUDIO_RUN_FRAMES;
+    if (pthread_create(&audio->thread, NULL, audioThread, audio) != 0)
+    {
+        sink->close(sink);
+        free(audio);
+        return NULL;
+    }
+    return audio;
+}
+
+int audioClose(chip8_audio* audio, audio_stats* stats)
+{
+    // at the end waiting is fine
+    struct timespec idle = { 0, 1000000 };
+    while (audio->runFrames && !pushRun(audio))
+        nanosleep(&idle, NULL);
+    __atomic_store_n(&audio->closing, 1, __ATOMIC_RELEASE);
+    pthread_join(audio->thread, NULL);
+
+    if (stats)
+    {
+        stats->frames = audio->frames;
+        stats->toneFrames = audio->toneFrames;
+        stats->dropped = audio->dropped;
+        stats->samples = audio->phase;
+    }
+    int result = audio->sink->close(audio->sink);
+    free(audio);
+    return result;
+}
+
+static void nullWrite(audio_sink* sink, const int16_t* samples, int count)
+{
+}
+
+static void nullStart(audio_sink* sink)
+{
+}
+
+static int nullClose(audio_sink* sink)
+{
+    free(sink);
+    return 0;
+}
+
+audio_sink* audioNullSink(void)
+{
+    audio_sink* sink = malloc(sizeof(audio_sink));
+    if (sink == NULL)
+        return NULL;
+    sink->write = nullWrite;
+    sink->start = nullStart;
+    sink->close = nullClose;
+    sink->ctx = NULL;
+    return sink;
+}
+
+typedef struct file_sink
+{
+    FILE* file;
+    int wav;
+    int rate;
+    int failed;
+    long long bytes; // of samples
+} file_sink;
+
+static void put16(unsigned char* p, unsigned int value)
+{
+    p[0] = value & 0xFF;
+    p[1] = (value >> 8) & 0xFF;
+}
+
+static void put32(unsigned char* p, uint32_t value)
+{
+    put16(p, value & 0xFFFF);
+    put16(p + 2, value >> 16);
+}
+
+static void writeWavHeader(file_sink* fs)
+{
+    // canonical 44 byte header of a mono 16 bit PCM file
+    unsigned char h[44];
+    uint32_t data = fs->bytes > 0xFFFFFFFFLL - 36 ? 0xFFFFFFFFu - 36 : (uint32_t) fs->bytes;
+    memcpy(h, "RIFF", 4);
+    put32(h + 4, 36 + data);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    put32(h + 16, 16);
+    put16(h + 20, 1); // PCM
+    put16(h + 22, 1); // channels
+    put32(h + 24, fs->rate);
+    put32(h + 28, fs->rate * 2);
+    put16(h + 32, 2); // block align
+    put16(h + 34, 16);
+    memcpy(h + 36, "data", 4);
+    put32(h + 40, data);
+    if (fwrite(h, 1, sizeof(h), fs->file) != sizeof(h))
+        fs->failed = 1;
+}
+
+static void fileWrite(audio_sink* sink, const int16_t* samples, int count)
+{
+    file_sink* fs = sink->ctx;
+    unsigned char bytes[2 * SYNTH_CHUNK];
+    while (count > 0)
+    {
+        int n = count < SYNTH_CHUNK ? count : SYNTH_CHUNK;
+        for (int i = 0; i < n; i++)
+            put16(bytes + 2*i, (uint16_t) samples[i]);
+        if (fwrite(bytes, 2, n, fs->file) != (size_t) n)
+            fs->failed = 1;
+        fs->bytes += 2 * n;
+        samples += n;
+        count -= n;
+    }
+}
+
+static int fileClose(audio_sink* sink)
+{
+    file_sink* fs = sink->ctx;
+    if (fs->wav)
+    {
+        // now that the sizes are known
+        if (fseek(fs->file, 0, SEEK_SET) == 0)
+            writeWavHeader(fs);
+        else
+            fs->failed = 1;
+    }
+    if (fclose(fs->file) != 0)
+        fs->failed = 1;
+    int result = fs->failed ? -1 : 0;
+    free(fs);
+    free(sink);
+    return result;
+}
+
+audio_sink* audioFileSink(const char* path, int rate)
+{
+    audio_sink* sink = malloc(sizeof(audio_sink));
+    file_sink* fs = calloc(1, sizeof(file_sink));
+    size_t len = strlen(path);
+    if (sink == NULL || fs == NULL || rate <= 0 || (fs->file = fopen(path, "wb")) == NULL)
+    {
+        free(sink);
+        free(fs);
+        return NULL;
+    }
+    fs->wav = len >= 4 && !strcmp(path + len - 4, ".wav");
+    fs->rate = rate;
+    if (fs->wav)
+        writeWavHeader(fs); // placeholder sizes
+    sink->write = fileWrite;
+    sink->start = nullStart;
+    sink->close = fileClose;
+    sink->ctx = fs;
+    return sink;
+}
+
+static void bellStart(audio_sink* sink)
+{
+    int fd = *(int*) sink->ctx;
+    if (write(fd, "\a", 1) < 0)
+        return; // nothing to do about a bell that did not ring
+}
+
+static int bellClose(audio_sink* sink)
+{
+    free(sink->ctx);
+    free(sink);
+    return 0;
+}
+
+audio_sink* audioBellSink(int fd)
+{
+    audio_sink* sink = malloc(sizeof(audio_sink));
+    int* ctx = malloc(sizeof(int));
+    if (sink == NULL || ctx == NULL)
+    {
+        free(sink);
+        free(ctx);
+        return NULL;
+    }
+    *ctx = fd;
+    sink->write = nullWrite;
+    sink->start = bellStart;
+    sink->close = bellClose;
+    sink->ctx = ctx;
+    return sink;
+}
@@ -0,0 +1,58 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <stdint.h>
+
+// sound stage off the emulation thread. every 60Hz timer tick the emulation thread adds
+// the frame's tone state (sound timer nonzero) to a run, and hands finished runs to the
+// audio thread through a single producer single consumer ring without locks or waits.
+// the audio thread turns runs into square wave PCM for a sink. if the audio thread falls
+// a whole ring behind, runs are dropped and counted instead of stalling emulation.
+
+#define AUDIO_RING 1024 // runs in flight, a power of two
+#define AUDIO_RUN_FRAMES 3 // frames a run holds before it is handed over, latency 50ms
+#define AUDIO_DEFAULT_RATE 44100
+#define AUDIO_TONE_HZ 440
+#define AUDIO_AMPLITUDE 8192
+
+typedef struct chip8_audio chip8_audio;
+typedef struct audio_sink audio_sink;
+
+// where samples go, called on the audio thread only
+struct audio_sink
+{
+    // count mono signed 16 bit samples at the stage's rate, silence included
+    void (*write)(audio_sink* sink, const int16_t* samples, int count);
+    // a tone starts, for sinks that only signal it
+    void (*start)(audio_sink* sink);
+    // flush and free the sink, returns -1 if anything failed to write
+    int (*close)(audio_sink* sink);
+    void* ctx;
+};
+
+// sinks, NULL if they cannot be set up
+// discards everything
+audio_sink* audioNullSink(void);
+// 16 bit mono PCM to path, as a WAV file if the name ends in .wav, raw little endian otherwise
+audio_sink* audioFileSink(const char* path, int rate);
+// writes BEL to fd when a tone starts, the old terminal beep without the per tick stalls
+audio_sink* audioBellSink(int fd);
+
+typedef struct audio_stats
+{
+    long long frames; // timer ticks seen
+    long long toneFrames; // of them with the sound timer running
+    long long dropped; // frames lost to a full ring
+    long long samples; // written to the sink
+} audio_stats;
+
+// start the audio thread feeding sink with rate samples/sec of a toneHz square wave. the
+// stage owns the sink from here on. NULL, with the sink closed, if the thread cannot start
+chip8_audio* audioCreate(audio_sink* sink, int rate, int toneHz);
+// one 60Hz frame from the emulation thread, tone nonzero while the sound timer runs
+void audioFrame(chip8_audio* audio, int tone);
+// hand over the last run, let the audio thread write everything and close the sink.
+// fills stats if given, returns the sink's close result
+int audioClose(chip8_audio* audio, audio_stats* stats);
+
+#endif
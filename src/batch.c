@@ -0,0 +1,149 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "chip8.h"
+#include "batch.h"
+#include "pool.h"
+#include "savestate.h"
+#include "stream.h"
+
+typedef struct batch_job
+{
+    char** roms;
+    long long cycles;
+    int tickInsts;
+    const char* streamDir;
+    batch_result* results;
+} batch_job;
+
+static int appendRom(char*** roms, int* count, const char* path)
+{
+    char** grown = realloc(*roms, (*count + 1) * sizeof(char*));
+    if (grown == NULL)
+        return -1;
+    *roms = grown;
+    (*roms)[(*count)++] = strdup(path);
+    return 1;
+}
+
+static int compareNames(const void* a, const void* b)
+{
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+int batchCollect(const char* source, char*** roms, int* count)
+{
+    struct stat info;
+    int first = *count;
+
+    if (source[0] == '@')
+    {
+        // list file, one ROM path per line
+        FILE* list = fopen(source+1, "r");
+        if (list == NULL)
+            return -1;
+        char line[4096];
+        while (fgets(line, sizeof(line), list))
+        {
+            line[strcspn(line, "\r\n")] = 0;
+            if (line[0] && appendRom(roms, count, line) < 0)
+                break;
+        }
+        fclose(list);
+    }
+    else if (stat(source, &info) == 0 && S_ISDIR(info.st_mode))
+    {
+        DIR* dir = opendir(source);
+        if (dir == NULL)
+            return -1;
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL)
+        {
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/%s", source, entry->d_name);
+            if (stat(path, &info) == 0 && S_ISREG(info.st_mode))
+                appendRom(roms, count, path);
+        }
+        closedir(dir);
+        // readdir order is arbitrary, keep summaries stable between runs
+        qsort(*roms + first, *count - first, sizeof(char*), compareNames);
+    }
+    else
+    {
+        appendRom(roms, count, source);
+    }
+    return *count - first;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void runOne(void* arg, int index)
+{
+    batch_job* job = arg;
+    batch_result* result = &job->results[index];
+    chip8_state* state = malloc(sizeof(chip8_state));
+
+    double start = now();
+    result->rom = job->roms[index];
+    result->status = -1;
+    if (state == NULL)
+        return;
+    chip8Init(state, &chip8NullFrontend);
+    if (job->streamDir)
+    {
+        const char* name = strrchr(job->roms[index], '/');
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s.c8f", job->streamDir, name ? name + 1 : job->roms[index]);
+        if ((state->stream = streamCreate(path)) == NULL)
+        {
+            free(state);
+            return;
+        }
+    }
+    // snapshots restore straight from a shared mapping instead of replaying the ROM's startup
+    if (saveOpen(state, job->roms[index]) >= 0)
+        result->status = chip8RunTicked(state, job->cycles, job->tickInsts);
+    if (state->stream && streamClose(state->stream, NULL) < 0)
+        result->status = -1;
+    result->wallSeconds = now() - start;
+    result->cycles = state->cycles;
+    result->pc = state->pc;
+    result->displayHash = chip8DisplayHash(state);
+    free(state);
+}
+
+void batchRun(char** roms, int count, long long cycles, int tickInsts, int threads, const char* streamDir, batch_result* results)
+{
+    batch_job job;
+    job.roms = roms;
+    job.cycles = cycles;
+    job.tickInsts = tickInsts;
+    job.streamDir = streamDir;
+    job.results = results;
+    poolRun(threads, count, runOne, &job);
+}
+
+void batchPrint(const batch_result* results, int count, double wallSeconds, FILE* out)
+{
+    long long total = 0;
+    fprintf(out, "rom\tstatus\tcycles\tpc\tfb_hash\twall_ms\n");
+    for (int i = 0; i < count; i++)
+    {
+        const batch_result* r = &results[i];
+        const char* status = r->status == CHIP8_OK ? "ok" : r->status == CHIP8_HALT ? "halt" : r->status == CHIP8_FAULT ? "fault" : "error";
+        fprintf(out, "%s\t%s\t%lld\t%03x\t%016llx\t%.3f\n", r->rom, status, r->cycles, r->pc, r->displayHash, r->wallSeconds * 1e3);
+        total += r->cycles;
+    }
+    fprintf(out, "# %d roms, %lld instructions in %.3f s (%.3f MIPS)\n", count, total, wallSeconds,
+        wallSeconds > 0 ? total / wallSeconds / 1e6 : 0.0);
+}
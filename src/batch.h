@@ -0,0 +1,29 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdio.h>
+
+// outcome of running one ROM of a batch
+typedef struct batch_result
+{
+    const char* rom;
+    int status; // CHIP8_OK if the cycle budget ran out, CHIP8_HALT if the ROM ended, CHIP8_FAULT, -1 if unreadable
+    long long cycles;
+    unsigned short pc;
+    unsigned long long displayHash;
+    double wallSeconds;
+} batch_result;
+
+// append the ROMs named by source to *roms: every file in a directory (sorted),
+// every line of an @list file, or source itself. returns the number added or -1
+int batchCollect(const char* source, char*** roms, int* count);
+
+// run every ROM headless for cycles instructions on threads worker threads,
+// one emulator instance per ROM, filling results[i] for roms[i]. with streamDir set
+// each ROM's frames are streamed to <streamDir>/<rom>.c8f (see stream.h)
+void batchRun(char** roms, int count, long long cycles, int tickInsts, int threads, const char* streamDir, batch_result* results);
+
+// one tab separated summary line per ROM plus a totals line
+void batchPrint(const batch_result* results, int count, double wallSeconds, FILE* out);
+
+#endif
@@ -0,0 +1,264 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "chip8.h"
+#include "jit.h"
+
+// throughput suite: synthetic ROMs that each stress one path of the core, run headless
+// for a fixed number of instructions several times, reported as ns/instruction in JSON
+
+#define BENCH_CYCLES 20000000
+#define BENCH_REPS 5
+#define BENCH_TICK_INSTS 8
+#define BENCH_MAX_INSTS 256
+
+typedef struct bench_rom
+{
+    const char* name;
+    int count;
+    unsigned short insts[BENCH_MAX_INSTS];
+} bench_rom;
+
+typedef struct bench_stats
+{
+    double mean;
+    double stddev;
+    double min;
+    double max;
+} bench_stats;
+
+// CALL/RET chain depth for the calls ROM
+#define CALL_DEPTH 8
+
+static void buildCalls(bench_rom* rom)
+{
+    // 200: CALL 204, 202: JP 200, then CALL_DEPTH subroutines that call the next and return
+    int n = 0;
+    rom->insts[n++] = 0x2204;
+    rom->insts[n++] = 0x1200;
+    for (int i = 0; i < CALL_DEPTH; i++)
+    {
+        unsigned short next = 0x204 + 4 * (i + 1);
+        rom->insts[n++] = i < CALL_DEPTH - 1 ? 0x2000 | next : 0x7001; // innermost does some work
+        rom->insts[n++] = 0x00EE;
+    }
+    rom->count = n;
+}
+
+static bench_rom roms[] = {
+    // 8XYN arithmetic and logic over a few registers
+    { "alu", 17, { 0x6001, 0x6102, 0x6203, 0x6304,
+        0x8010, 0x8121, 0x8232, 0x8303, 0x8014, 0x8125, 0x8016, 0x8127, 0x801E, 0x8234, 0x8315, 0x7001, 0x1208 } },
+    // DRW of 1, 8 and 15 row sprites moving across the screen
+    { "draw1", 7, { 0xA050, 0x6000, 0x6100, 0xD011, 0x7008, 0x7103, 0x1206 } },
+    { "draw8", 7, { 0xA050, 0x6000, 0x6100, 0xD018, 0x7008, 0x7103, 0x1206 } },
+    { "draw15", 7, { 0xA050, 0x6000, 0x6100, 0xD01F, 0x7008, 0x7103, 0x1206 } },
+    // 15 row sprite at x=60, y=28 so it wraps on both edges
+    { "drawwrap", 5, { 0xA050, 0x603C, 0x611C, 0xD01F, 0x1206 } },
+    // FX55/FX65 of all 16 registers outside the code, I reloaded since profiles that
+    // advance it would walk off the end of ram
+    { "mem", 4, { 0xA400, 0xFF55, 0xFF65, 0x1200 } },
+    { "calls", 0, { 0 } },
+    // 16x16 hires sprites moving across the 128x64 screen, and hires scrolls of it
+    { "hires16", 8, { 0x00FF, 0xA050, 0x6000, 0x6100, 0xD010, 0x7011, 0x7105, 0x1208 } },
+    { "scroll", 5, { 0x00FF, 0x00C1, 0x00FB, 0x00FC, 0x1202 } },
+    // XO-CHIP draw to both planes clipped at the bottom edge, each plane's 8 row sprite
+    // following the other's at I, always under a clipping profile (see checkClippedPlanes)
+    { "planeclip", 10, { 0xF301, 0xA20C, 0x6000, 0x611C, 0xD018, 0x1208,
+        0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0x0102, 0x0304, 0x0506, 0x0708 } },
+    // SE/SNE with both outcomes as V0 counts up
+    { "skips", 13, { 0x6000, 0x6101,
+        0x3000, 0x7101, 0x4000, 0x7101, 0x5010, 0x7101, 0x9010, 0x7101, 0x3101, 0x7001, 0x1204 } },
+};
+
+#define BENCH_ROMS (int)(sizeof(roms) / sizeof(roms[0]))
+
+// the profile rom runs under: planeclip needs DXYN to clip whatever -q picks
+static int romQuirks(const bench_rom* rom, int quirks)
+{
+    return strcmp(rom->name, "planeclip") ? quirks : CHIP8_QUIRKS_SCHIP;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ns per instruction of one fresh run of rom
+static double runOnce(const bench_rom* rom, long long cycles, int tickInsts, int quirks, chip8_jit* jit)
+{
+    static chip8_state state;
+    unsigned char image[2 * BENCH_MAX_INSTS];
+    for (int i = 0; i < rom->count; i++)
+    {
+        image[2*i] = rom->insts[i] >> 8;
+        image[2*i+1] = rom->insts[i] & 0xFF;
+    }
+    chip8Init(&state, NULL);
+    chip8SetQuirks(&state, romQuirks(rom, quirks));
+    chip8LoadRomBuffer(&state, image, 2 * rom->count);
+    if (jit)
+        chip8JitReset(jit);
+
+    double start = now();
+    if (jit)
+        chip8JitRunTicked(jit, &state, cycles, tickInsts);
+    else
+        chip8RunTicked(&state, cycles, tickInsts);
+    double seconds = now() - start;
+    return state.cycles > 0 ? seconds * 1e9 / state.cycles : 0;
+}
+
+// the first DXYN of planeclip must leave rows 28-31 of each plane with the top of that
+// plane's own sprite, in the interpreter and the translator alike
+static int checkClippedPlanes(const bench_rom* rom, chip8_jit* jit)
+{
+    static chip8_state state;
+    for (int core = 0; core < 2; core++)
+    {
+        unsigned char image[2 * BENCH_MAX_INSTS];
+        for (int i = 0; i < rom->count; i++)
+        {
+            image[2*i] = rom->insts[i] >> 8;
+            image[2*i+1] = rom->insts[i] & 0xFF;
+        }
+        chip8Init(&state, NULL);
+        chip8SetQuirks(&state, romQuirks(rom, 0));
+        chip8LoadRomBuffer(&state, image, 2 * rom->count);
+        if (core)
+        {
+            chip8JitReset(jit);
+            chip8JitRunTicked(jit, &state, 5, BENCH_TICK_INSTS);
+        }
+        else
+            chip8RunTicked(&state, 5, BENCH_TICK_INSTS);
+        for (int plane = 0; plane < 2; plane++)
+        {
+            for (int row = 0; row < 4; row++)
+            {
+                uint64_t want = (uint64_t) image[12 + 8 * plane + row] << 56;
+                if (state.cycles != 5 || state.display[plane][0][28 + row] != want)
+                {
+                    printf("%s: plane %d row %d is wrong after a clipped draw\n", core ? "translator" : "interpreter", plane, 28 + row);
+                    return -1;
+                }
+            }
+        }
+        if (jit == NULL)
+            break;
+    }
+    return 0;
+}
+
+static void summarize(const double* samples, int count, bench_stats* out)
+{
+    double sum = 0;
+    out->min = samples[0];
+    out->max = samples[0];
+    for (int i = 0; i < count; i++)
+    {
+        sum += samples[i];
+        if (samples[i] < out->min)
+            out->min = samples[i];
+        if (samples[i] > out->max)
+            out->max = samples[i];
+    }
+    out->mean = sum / count;
+    double var = 0;
+    for (int i = 0; i < count; i++)
+        var += (samples[i] - out->mean) * (samples[i] - out->mean);
+    out->stddev = count > 1 ? sqrt(var / (count - 1)) : 0;
+}
+
+int main(int argc, char** argv)
+{
+    long long cycles = BENCH_CYCLES;
+    int reps = BENCH_REPS;
+    int tickInsts = BENCH_TICK_INSTS;
+    int useJit = 0;
+    const char* quirksName = "modern";
+    const char* only = NULL;
+    const char* outName = NULL;
+    for (int argi = 1; argi < argc; argi++)
+    {
+        if (!strcmp(argv[argi], "-n") && argi+1 < argc)
+            cycles = atoll(argv[++argi]);
+        else if (!strcmp(argv[argi], "-r") && argi+1 < argc)
+            reps = atoi(argv[++argi]);
+        else if (!strcmp(argv[argi], "-k") && argi+1 < argc)
+            tickInsts = atoi(argv[++argi]);
+        else if (!strcmp(argv[argi], "-x"))
+            useJit = 1;
+        else if (!strcmp(argv[argi], "-q") && argi+1 < argc)
+            quirksName = argv[++argi];
+        else if (!strcmp(argv[argi], "-f") && argi+1 < argc)
+            only = argv[++argi];
+        else if (!strcmp(argv[argi], "-o") && argi+1 < argc)
+            outName = argv[++argi];
+        else
+        {
+            printf("Usage: %s [-n <cycles>] [-r <reps>] [-k <insts>] [-x] [-q <quirks>] [-f <name>] [-o <file>]\n", argv[0]);
+            printf("       runs each synthetic ROM for <cycles> instructions (default %d) <reps> times (default %d),\n", BENCH_CYCLES, BENCH_REPS);
+            printf("       ticking timers every <insts>, through the block translator with -x, and writes\n");
+            printf("       ns/instruction statistics as JSON to <file> or stdout. -f runs only the named ROM,\n");
+            printf("       -q runs the chip8, schip or modern (default) quirks profile.\n");
+            return 1;
+        }
+    }
+    int quirks = chip8QuirksByName(quirksName);
+    if (cycles <= 0 || reps <= 0 || tickInsts <= 0 || quirks < 0)
+        return 1;
+
+    FILE* out = outName ? fopen(outName, "w") : stdout;
+    if (out == NULL)
+    {
+        printf("cannot write %s\n", outName);
+        return 1;
+    }
+
+    for (int i = 0; i < BENCH_ROMS; i++)
+    {
+        if (!strcmp(roms[i].name, "calls"))
+            buildCalls(&roms[i]);
+    }
+    chip8_jit* jit = useJit ? chip8JitCreate() : NULL;
+    for (int i = 0; i < BENCH_ROMS; i++)
+    {
+        if (!strcmp(roms[i].name, "planeclip") && checkClippedPlanes(&roms[i], jit) < 0)
+            return 1;
+    }
+    double* samples = malloc(reps * sizeof(double));
+
+    fprintf(out, "{\n  \"core\": \"%s\",\n  \"quirks\": \"%s\",\n  \"cycles\": %lld,\n  \"reps\": %d,\n  \"tickInsts\": %d,\n  \"benchmarks\": [",
+        useJit ? "translator" : "interpreter", quirksName, cycles, reps, tickInsts);
+    const char* sep = "";
+    for (int i = 0; i < BENCH_ROMS; i++)
+    {
+        if (only && strcmp(only, roms[i].name))
+            continue;
+        // one untimed run to warm caches and the decoded instructions
+        runOnce(&roms[i], cycles / 10 + 1, tickInsts, quirks, jit);
+        for (int r = 0; r < reps; r++)
+            samples[r] = runOnce(&roms[i], cycles, tickInsts, quirks, jit);
+        bench_stats stats;
+        summarize(samples, reps, &stats);
+        fprintf(out, "%s\n    { \"name\": \"%s\", \"ns_per_inst\": { \"mean\": %.4f, \"stddev\": %.4f, \"min\": %.4f, \"max\": %.4f }, \"mips\": %.1f }",
+            sep, roms[i].name, stats.mean, stats.stddev, stats.min, stats.max, stats.mean > 0 ? 1e3 / stats.mean : 0.0);
+        sep = ",";
+        if (out != stdout)
+            printf("%-10s %8.3f ns/inst +- %.3f\n", roms[i].name, stats.mean, stats.stddev);
+    }
+    fprintf(out, "\n  ]\n}\n");
+
+    if (out != stdout)
+        fclose(out);
+    free(samples);
+    chip8JitDestroy(jit);
+    return 0;
+}
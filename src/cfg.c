@@ -0,0 +1,407 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "cfg.h"
+#include "pool.h"
+
+typedef struct cfg_job
+{
+    char** roms;
+    int dot;
+    const char* outDir;
+    cfg_result* results;
+} cfg_job;
+
+// control flow leaving one instruction
+typedef struct cfg_flow
+{
+    int count; // successors in next
+    unsigned short next[2];
+    int call; // next[1] is a CALL target, next[0] where it returns to
+    int jump; // BNNN, next[0] is only the table base
+    int stop; // RET
+    int invalid; // not an instruction
+} cfg_flow;
+
+static unsigned short fetch(const unsigned char* ram, unsigned int addr)
+{
+    return (((unsigned short)ram[addr]) << 8) | ram[(addr+1) & (MEM_SIZE-1)];
+}
+
+static int inRom(const chip8_cfg* cfg, unsigned int addr)
+{
+    return addr >= START_ADDR && addr + 1 < cfg->romEnd;
+}
+
+static void flowOf(const unsigned char* ram, unsigned int addr, cfg_flow* out)
+{
+    chip8_decoded d;
+    chip8Decode(fetch(ram, addr), &d);
+    memset(out, 0, sizeof(*out));
+    switch (d.op)
+    {
+        case CHIP8_OP_RET:
+            out->stop = 1;
+            break;
+        case CHIP8_OP_EXIT:
+            break;
+        case CHIP8_OP_JP:
+            out->next[out->count++] = d.nnn;
+            break;
+        case CHIP8_OP_CALL:
+            out->next[out->count++] = addr + 2;
+            out->next[out->count++] = d.nnn;
+            out->call = 1;
+            break;
+        case CHIP8_OP_JP_V0:
+            out->next[out->count++] = d.nnn;
+            out->jump = 1;
+            break;
+        case CHIP8_OP_SE_VX_NN: case CHIP8_OP_SNE_VX_NN: case CHIP8_OP_SE_VX_VY:
+        case CHIP8_OP_SNE_VX_VY: case CHIP8_OP_SKP: case CHIP8_OP_SKNP:
+            out->next[out->count++] = addr + 2;
+            out->next[out->count++] = addr + 4;
+            break;
+        case CHIP8_OP_INVALID:
+            // the interpreter steps over these, but on a reachable path they almost
+            // always mean the traversal has wandered into data
+            out->invalid = 1;
+            break;
+        default:
+            out->next[out->count++] = addr + 2;
+            break;
+    }
+}
+
+// instruction at addr ends its block
+static int endsBlock(const chip8_cfg* cfg, const unsigned char* ram, unsigned int addr)
+{
+    cfg_flow flow;
+    flowOf(ram, addr, &flow);
+    unsigned int after = addr + 2;
+    return flow.count != 1 || flow.next[0] != after || flow.call || flow.jump
+        || !inRom(cfg, after) || !(cfg->flags[after] & CFG_CODE) || (cfg->flags[after] & CFG_BLOCK);
+}
+
+static void addCall(chip8_cfg* cfg, unsigned short from, unsigned short to)
+{
+    for (int i = 0; i < cfg->callCount; i++)
+    {
+        if (cfg->calls[i].from == from && cfg->calls[i].to == to)
+            return;
+    }
+    if (cfg->callCount < CFG_MAX_CALLS)
+    {
+        cfg->calls[cfg->callCount].from = from;
+        cfg->calls[cfg->callCount].to = to;
+        cfg->callCount++;
+    }
+}
+
+// follow the body of the function at entry without entering its callees, recording calls
+static void walkFunction(chip8_cfg* cfg, const unsigned char* ram, unsigned short entry, unsigned char* seen)
+{
+    unsigned short work[MEM_SIZE];
+    int top = 0;
+    memset(seen, 0, MEM_SIZE);
+    work[top++] = entry;
+    seen[entry] = 1;
+    while (top > 0)
+    {
+        unsigned short addr = work[--top];
+        cfg_flow flow;
+        flowOf(ram, addr, &flow);
+        if (flow.call)
+        {
+            addCall(cfg, entry, flow.next[1]);
+            flow.count = 1;
+        }
+        for (int i = 0; i < flow.count; i++)
+        {
+            unsigned short next = flow.next[i];
+            if (inRom(cfg, next) && !seen[next] && (cfg->flags[next] & CFG_CODE))
+            {
+                seen[next] = 1;
+                work[top++] = next;
+            }
+        }
+    }
+}
+
+void cfgAnalyze(const unsigned char* ram, long romSize, chip8_cfg* out)
+{
+    // each address is queued at most once, so work cannot overflow
+    unsigned short work[MEM_SIZE];
+    unsigned char queued[MEM_SIZE] = { 0 };
+    int top = 0;
+
+    memset(out, 0, sizeof(*out));
+    out->romEnd = START_ADDR + (romSize < MEM_SIZE - START_ADDR ? romSize : MEM_SIZE - START_ADDR);
+    if (!inRom(out, START_ADDR))
+        return;
+    out->flags[START_ADDR] |= CFG_BLOCK | CFG_FUNC;
+    work[top++] = START_ADDR;
+    queued[START_ADDR] = 1;
+
+    while (top > 0)
+    {
+        unsigned short addr = work[--top];
+        cfg_flow flow;
+        flowOf(ram, addr, &flow);
+        if (flow.invalid)
+            continue; // leave it to the data listing
+        out->flags[addr] |= CFG_CODE;
+        out->flags[addr+1] |= CFG_OPERAND;
+
+        int branches = flow.count != 1 || flow.next[0] != addr + 2;
+        for (int i = 0; i < flow.count; i++)
+        {
+            unsigned short target = flow.next[i];
+            if (!inRom(out, target))
+                continue;
+            if (branches || flow.call)
+                out->flags[target] |= CFG_BLOCK;
+            if (flow.call && i == 1)
+                out->flags[target] |= CFG_FUNC;
+            if (flow.jump)
+            {
+                // BNNN usually indexes a table of JPs, follow the run of them at the base
+                out->flags[target] |= CFG_INDIRECT;
+                for (unsigned int entry = target; inRom(out, entry) && (ram[entry] >> 4) == 0x1; entry += 2)
+                {
+                    out->flags[entry] |= CFG_BLOCK;
+                    if (!queued[entry])
+                    {
+                        queued[entry] = 1;
+                        work[top++] = entry;
+                    }
+                }
+            }
+            if (!queued[target])
+            {
+                queued[target] = 1;
+                work[top++] = target;
+            }
+        }
+    }
+
+    for (unsigned int addr = START_ADDR; addr < out->romEnd; addr++)
+    {
+        unsigned char flags = out->flags[addr];
+        if (flags & CFG_CODE)
+        {
+            out->insts++;
+            // a block target that turned out to be invalid is no block
+            out->blocks += (flags & CFG_BLOCK) != 0;
+            out->funcs += (flags & CFG_FUNC) != 0;
+        }
+        else if (!(flags & CFG_OPERAND))
+            out->dataBytes++;
+    }
+
+    unsigned char seen[MEM_SIZE];
+    for (unsigned int addr = START_ADDR; addr < out->romEnd; addr++)
+    {
+        if ((out->flags[addr] & (CFG_CODE | CFG_FUNC)) == (CFG_CODE | CFG_FUNC))
+            walkFunction(out, ram, addr, seen);
+    }
+}
+
+static void printTarget(const chip8_cfg* cfg, unsigned short addr, FILE* out)
+{
+    if (!inRom(cfg, addr) || !(cfg->flags[addr] & CFG_CODE))
+        fprintf(out, "%03x?", addr);
+    else
+        fprintf(out, "%s_%03x", (cfg->flags[addr] & CFG_FUNC) ? "sub" : "L", addr);
+}
+
+static void printSuccessors(const chip8_cfg* cfg, const unsigned char* ram, unsigned int addr, FILE* out)
+{
+    cfg_flow flow;
+    flowOf(ram, addr, &flow);
+    fprintf(out, "                ; ");
+    if (flow.stop)
+        fprintf(out, "return");
+    else if (flow.invalid || flow.count == 0)
+        fprintf(out, "stop");
+    else
+    {
+        fprintf(out, "-> ");
+        if (flow.call)
+        {
+            printTarget(cfg, flow.next[0], out);
+            fprintf(out, " after call ");
+            printTarget(cfg, flow.next[1], out);
+        }
+        else
+        {
+            for (int i = 0; i < flow.count; i++)
+            {
+                fprintf(out, i ? ", " : "");
+                if (flow.jump)
+                    fprintf(out, "V0 + ");
+                printTarget(cfg, flow.next[i], out);
+            }
+        }
+    }
+    fprintf(out, "\n");
+}
+
+void cfgWriteText(const chip8_cfg* cfg, const unsigned char* ram, FILE* out)
+{
+    fprintf(out, "; %u bytes: %d instructions in %d blocks, %d functions, %d data bytes\n",
+        cfg->romEnd - START_ADDR, cfg->insts, cfg->blocks, cfg->funcs, cfg->dataBytes);
+
+    unsigned int addr = START_ADDR;
+    while (addr < cfg->romEnd)
+    {
+        unsigned char flags = cfg->flags[addr];
+        if (flags & CFG_CODE)
+        {
+            if (flags & CFG_BLOCK)
+            {
+                fprintf(out, "\n");
+                printTarget(cfg, addr, out);
+                fprintf(out, ":%s\n", (flags & CFG_INDIRECT) ? " ; jump table" : "");
+            }
+            unsigned short inst = fetch(ram, addr);
+            char text[32];
+            chip8Disassemble(inst, text, sizeof(text));
+            fprintf(out, "%4x [%04x]: %s\n", addr, inst, text);
+            if (endsBlock(cfg, ram, addr))
+                printSuccessors(cfg, ram, addr, out);
+            addr += 2;
+            continue;
+        }
+
+        // a row of up to 8 data bytes, up to the next instruction
+        fprintf(out, "%4x  db", addr);
+        for (int i = 0; i < 8 && addr < cfg->romEnd && !(cfg->flags[addr] & CFG_CODE); i++, addr++)
+            fprintf(out, " %02x", ram[addr]);
+        fprintf(out, "\n");
+    }
+
+    if (cfg->callCount > 0)
+        fprintf(out, "\n; call graph\n");
+    for (int i = 0; i < cfg->callCount; i++)
+    {
+        fprintf(out, "; ");
+        printTarget(cfg, cfg->calls[i].from, out);
+        fprintf(out, " -> ");
+        printTarget(cfg, cfg->calls[i].to, out);
+        fprintf(out, "\n");
+    }
+}
+
+void cfgWriteDot(const chip8_cfg* cfg, const unsigned char* ram, FILE* out)
+{
+    fprintf(out, "digraph chip8 {\n    node [shape=box fontname=monospace];\n");
+
+    // one node per block listing its instructions, then its edges
+    unsigned int addr = START_ADDR;
+    while (addr < cfg->romEnd)
+    {
+        if (!(cfg->flags[addr] & CFG_CODE))
+        {
+            addr++;
+            continue;
+        }
+        unsigned int start = addr;
+        fprintf(out, "    b%03x [label=\"", start);
+        printTarget(cfg, start, out);
+        fprintf(out, ":\\l");
+        for (;;)
+        {
+            unsigned short inst = fetch(ram, addr);
+            char text[32];
+            chip8Disassemble(inst, text, sizeof(text));
+            fprintf(out, "%03x: %s\\l", addr, text);
+            if (endsBlock(cfg, ram, addr))
+                break;
+            addr += 2;
+        }
+        fprintf(out, "\"%s];\n", (cfg->flags[start] & CFG_FUNC) ? " peripheries=2" : "");
+
+        cfg_flow flow;
+        flowOf(ram, addr, &flow);
+        for (int i = 0; i < flow.count; i++)
+        {
+            unsigned short target = flow.next[i];
+            if (!inRom(cfg, target) || !(cfg->flags[target] & CFG_CODE))
+                continue;
+            const char* style = (flow.call && i == 1) ? " [style=dashed]" : flow.jump ? " [style=dotted]" : "";
+            fprintf(out, "    b%03x -> b%03x%s;\n", start, target, style);
+        }
+        addr += 2;
+    }
+    fprintf(out, "}\n");
+}
+
+static void analyzeOne(void* arg, int index)
+{
+    cfg_job* job = arg;
+    cfg_result* result = &job->results[index];
+    chip8_state* state = malloc(sizeof(chip8_state));
+    chip8_cfg* cfg = malloc(sizeof(chip8_cfg));
+
+    result->rom = job->roms[index];
+    result->status = -1;
+    if (state == NULL || cfg == NULL)
+        goto done;
+    chip8Init(state, &chip8NullFrontend);
+    long romSize = chip8LoadRom(state, job->roms[index]);
+    if (romSize < 0)
+        goto done;
+    cfgAnalyze(state->ram, romSize, cfg);
+    result->insts = cfg->insts;
+    result->blocks = cfg->blocks;
+    result->funcs = cfg->funcs;
+    result->dataBytes = cfg->dataBytes;
+    result->calls = cfg->callCount;
+
+    FILE* out;
+    if (job->outDir)
+    {
+        const char* name = strrchr(job->roms[index], '/');
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s.%s", job->outDir, name ? name + 1 : job->roms[index], job->dot ? "dot" : "asm");
+        out = fopen(path, "w");
+    }
+    else
+        out = open_memstream(&result->text, &result->size);
+    if (out == NULL)
+        goto done;
+    if (job->dot)
+        cfgWriteDot(cfg, state->ram, out);
+    else
+        cfgWriteText(cfg, state->ram, out);
+    result->status = (ferror(out) | fclose(out)) ? -1 : 0;
+
+done:
+    free(cfg);
+    free(state);
+}
+
+void cfgRunCorpus(char** roms, int count, int threads, int dot, const char* outDir, cfg_result* results)
+{
+    cfg_job job;
+    job.roms = roms;
+    job.dot = dot;
+    job.outDir = outDir;
+    job.results = results;
+    poolRun(threads, count, analyzeOne, &job);
+}
+
+void cfgPrintSummary(const cfg_result* results, int count, FILE* out)
+{
+    fprintf(out, "rom\tstatus\tinsts\tblocks\tfuncs\tcalls\tdata_bytes\n");
+    for (int i = 0; i < count; i++)
+    {
+        const cfg_result* r = &results[i];
+        fprintf(out, "%s\t%s\t%d\t%d\t%d\t%d\t%d\n", r->rom, r->status == 0 ? "ok" : "error",
+            r->insts, r->blocks, r->funcs, r->calls, r->dataBytes);
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include <stdio.h>
+
+#include "chip8.h"
+
+// recursive traversal disassembly: starting at START_ADDR, follow fall through, JP,
+// CALL, skip and BNNN targets so only reachable bytes are decoded as code. everything
+// else in the ROM is data, which also keeps code after odd sized data aligned right.
+
+// per byte flags
+#define CFG_CODE 0x01 // first byte of a reachable instruction
+#define CFG_OPERAND 0x02 // second byte of one
+#define CFG_BLOCK 0x04 // starts a basic block
+#define CFG_FUNC 0x08 // entry point or CALL target
+#define CFG_INDIRECT 0x10 // BNNN base, the real target also depends on V0
+
+#define CFG_MAX_CALLS 1024
+
+typedef struct cfg_call
+{
+    unsigned short from; // calling function
+    unsigned short to;
+} cfg_call;
+
+typedef struct chip8_cfg
+{
+    unsigned char flags[MEM_SIZE];
+    unsigned int romEnd;
+    int insts;
+    int blocks;
+    int funcs;
+    int dataBytes;
+    int callCount; // distinct function to function calls, capped at CFG_MAX_CALLS
+    cfg_call calls[CFG_MAX_CALLS];
+} chip8_cfg;
+
+// analyze the romSize bytes loaded at START_ADDR in ram
+void cfgAnalyze(const unsigned char* ram, long romSize, chip8_cfg* out);
+// listing with function and block labels, code vs data and each block's successors
+void cfgWriteText(const chip8_cfg* cfg, const unsigned char* ram, FILE* out);
+// basic blocks and their edges plus the call graph as a Graphviz digraph
+void cfgWriteDot(const chip8_cfg* cfg, const unsigned char* ram, FILE* out);
+
+// outcome of analyzing one ROM of a corpus
+typedef struct cfg_result
+{
+    const char* rom;
+    int status; // 0, or -1 if the ROM is unreadable or its output could not be written
+    int insts;
+    int blocks;
+    int funcs;
+    int dataBytes;
+    int calls;
+    char* text; // listing or DOT when not written to a directory, free() it
+    size_t size;
+} cfg_result;
+
+// analyze every ROM on threads worker threads, filling results[i] for roms[i]. the text
+// listing, or the DOT graph if dot is set, goes to <outDir>/<rom name>.asm or .dot, or
+// into results[i].text when outDir is NULL
+void cfgRunCorpus(char** roms, int count, int threads, int dot, const char* outDir, cfg_result* results);
+// one tab separated line of counts per ROM
+void cfgPrintSummary(const cfg_result* results, int count, FILE* out);
+
+#endif
@@ -0,0 +1,343 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "chip8.h"
+#include "ops.h"
+#include "profile.h"
+#include "audio.h"
+#include "trace.h"
+#include "stream.h"
+
+static void initializeFont(unsigned char* ram_out);
+
+void chip8Init(chip8_state* state, chip8_frontend* frontend)
+{
+    // initialize registers, display and ram
+    memset(state, 0, sizeof(*state));
+    state->pc = START_ADDR;
+    state->frontend = frontend ? frontend : &chip8NullFrontend;
+    chip8Seed(state, CHIP8_DEFAULT_SEED);
+    state->quirks = CHIP8_QUIRKS_MODERN;
+    state->planes = 1;
+
+    // initialize font
+    initializeFont(state->ram);
+}
+
+void chip8Seed(chip8_state* state, uint32_t seed)
+{
+    // xorshift never leaves 0
+    state->rng = seed ? seed : CHIP8_DEFAULT_SEED;
+}
+
+int chip8SetQuirks(chip8_state* state, unsigned int quirks)
+{
+    if (quirks != CHIP8_QUIRKS_CHIP8 && quirks != CHIP8_QUIRKS_SCHIP && quirks != CHIP8_QUIRKS_MODERN)
+        return -1;
+    state->quirks = quirks;
+    return 0;
+}
+
+int chip8QuirksByName(const char* name)
+{
+    if (!strcmp(name, "chip8"))
+        return CHIP8_QUIRKS_CHIP8;
+    if (!strcmp(name, "schip"))
+        return CHIP8_QUIRKS_SCHIP;
+    if (!strcmp(name, "modern"))
+        return CHIP8_QUIRKS_MODERN;
+    return -1;
+}
+
+long int chip8LoadRom(chip8_state* state, const char* rom_in)
+{
+    // open file
+    FILE *romPtr = fopen(rom_in, "rb");
+    if (romPtr == NULL)
+    {
+        printf("invalid file: %s\n", rom_in);
+        return -1;
+    }
+
+    // determine ROM size
+    long int rom_size = 0;
+    long int max_size = MEM_SIZE - START_ADDR;
+    fseek(romPtr, 0, SEEK_END);
+    rom_size = ftell(romPtr);
+    rewind(romPtr);
+    if (rom_size < 0)
+    {
+        // not a regular file
+        printf("invalid file: %s\n", rom_in);
+        fclose(romPtr);
+        return -1;
+    }
+    if (rom_size > max_size)
+    {
+        printf("ROM is larger than RAM, only reading first %ld bytes", max_size);
+        rom_size = max_size;
+    }
+
+    //read in
+    rom_size = (long int) fread(&state->ram[START_ADDR], sizeof(unsigned char), rom_size, romPtr);
+
+    fclose(romPtr);
+
+    chip8InvalidateCode(state, START_ADDR, rom_size);
+    state->romSize = rom_size;
+    return rom_size;
+}
+
+long int chip8LoadRomBuffer(chip8_state* state, const unsigned char* rom, long int size)
+{
+    if (size > MEM_SIZE - START_ADDR)
+        size = MEM_SIZE - START_ADDR;
+    memcpy(&state->ram[START_ADDR], rom, size);
+    chip8InvalidateCode(state, START_ADDR, size);
+    state->romSize = size;
+    return size;
+}
+
+void chip8InvalidateCode(chip8_state* state, unsigned short addr, int len)
+{
+    // the instruction starting one byte earlier also covers addr
+    for (int i = -1; i < len; i++)
+        state->decoded[(addr + i) & (MEM_SIZE-1)].op = CHIP8_OP_DECODE;
+
+    // flag pages with translated blocks for the block translator to flush
+    if (state->codePages)
+    {
+        for (int i = -1; i < len; i += CODE_PAGE)
+            state->dirtyPages |= state->codePages & (1ULL << (((addr + i) & (MEM_SIZE-1)) / CODE_PAGE));
+        state->dirtyPages |= state->codePages & (1ULL << (((addr + len - 1) & (MEM_SIZE-1)) / CODE_PAGE));
+    }
+}
+
+int chip8Step(chip8_state* state)
+{
+    return chip8Run(state, 1);
+}
+
+// threaded dispatch on the decoded handler index: computed goto where the compiler
+// supports it, a switch otherwise
+#ifdef __GNUC__
+#define CHIP8_OP_LABEL(name) &&op_##name,
+#define DISPATCH(op) goto *handlers[op];
+#define CASE(name) op_##name:
+#else
+#define DISPATCH(op) switch (op)
+#define CASE(name) case CHIP8_OP_##name:
+#endif
+// continue with the instruction at newPc
+#define NEXT(newPc) do { pc = (newPc); goto next; } while (0)
+// stop on the instruction at pc without executing it, it does not count as a cycle
+#define FAULT(kind) do { state->fault = (kind); status = CHIP8_FAULT; left++; goto done; } while (0)
+
+#define INTERP_NAME runChip8
+#define INTERP_QUIRKS CHIP8_QUIRKS_CHIP8
+#include "interp.h"
+#define INTERP_NAME runSchip
+#define INTERP_QUIRKS CHIP8_QUIRKS_SCHIP
+#include "interp.h"
+#define INTERP_NAME runModern
+#define INTERP_QUIRKS CHIP8_QUIRKS_MODERN
+#include "interp.h"
+// traced copy, which reads the profile at run time since the trace hooks dominate its cost
+#define INTERP_NAME runTraced
+#define INTERP_QUIRKS (state->quirks)
+#define INTERP_TRACE
+#include "interp.h"
+
+int chip8Run(chip8_state* state, long long cycles)
+{
+    if (state->trace)
+        return runTraced(state, cycles);
+    // the profile only changes at load, so this is as predictable as a direct call
+    switch (state->quirks)
+    {
+        case CHIP8_QUIRKS_CHIP8: return runChip8(state, cycles);
+        case CHIP8_QUIRKS_SCHIP: return runSchip(state, cycles);
+        default: return runModern(state, cycles);
+    }
+}
+
+#undef DISPATCH
+#undef CASE
+#undef NEXT
+#undef FAULT
+
+int chip8RunTicked(chip8_state* state, long long cycles, int tickInsts)
+{
+    int status = CHIP8_OK;
+    long long end = state->cycles + cycles;
+    while (status == CHIP8_OK && state->cycles < end)
+    {
+        // run up to the next timer tick
+        long long slice = tickInsts - state->cycles % tickInsts;
+        if (slice > end - state->cycles)
+            slice = end - state->cycles;
+        status = chip8Run(state, slice);
+        if (status == CHIP8_OK && state->cycles % tickInsts == 0)
+            chip8TickTimers(state);
+    }
+    return status;
+}
+
+int chip8IdleLoop(chip8_state* state, unsigned short pc)
+{
+    chip8_decoded* d[3];
+    if (pc + 4 >= state->romSize + START_ADDR)
+        return 0;
+    for (int i = 0; i < 3; i++)
+    {
+        unsigned short addr = pc + 2 * i;
+        d[i] = &state->decoded[addr];
+        if (d[i]->op == CHIP8_OP_DECODE)
+            chip8Decode((((unsigned short)state->ram[addr]) << 8) | ((unsigned short)state->ram[addr+1]), d[i]);
+    }
+    if (d[0]->op != CHIP8_OP_LD_VX_DT || d[2]->op != CHIP8_OP_JP || d[2]->nnn != pc || d[1]->x != d[0]->x)
+        return 0;
+
+    // Vx is loaded from the timer on every pass
+    unsigned char vx = state->delayTimer;
+    unsigned char nn = d[1]->nnn & 0xFF;
+    if (d[1]->op == CHIP8_OP_SE_VX_NN)
+        return vx != nn;
+    if (d[1]->op == CHIP8_OP_SNE_VX_NN)
+        return vx == nn;
+    return 0;
+}
+
+void chip8TickTimers(chip8_state* state)
+{
+    if (state->delayTimer > 0)
+        state->delayTimer--;
+    // the audio stage hears silent frames too, it only queues them so never blocks
+    if (state->audio)
+        audioFrame(state->audio, state->soundTimer > 0);
+    if (state->stream)
+        streamFrame(state->stream, state);
+    if (state->soundTimer > 0)
+    {
+        if (!state->audio)
+            state->frontend->beep(state->frontend);
+        state->soundTimer--;
+    }
+}
+
+const char* chip8FaultName(int fault)
+{
+    switch (fault)
+    {
+        case CHIP8_FAULT_STACK_OVERFLOW: return "stack overflow";
+        case CHIP8_FAULT_STACK_UNDERFLOW: return "stack underflow";
+        case CHIP8_FAULT_MEMORY: return "memory access past the end of ram";
+        default: return "none";
+    }
+}
+
+static int planeBlank(const chip8_state* state, int plane)
+{
+    for (int w = 0; w < DISPLAY_WORDS; w++)
+    {
+        for (int row = 0; row < DISPLAY_HIRES_H; row++)
+        {
+            if (state->display[plane][w][row])
+                return 0;
+        }
+    }
+    return 1;
+}
+
+unsigned long long chip8DisplayHash(const chip8_state* state)
+{
+    // hash rows left to right so the value does not depend on host byte order. a blank
+    // second plane adds nothing, so plain CHIP-8 hashes match those of earlier versions
+    unsigned long long hash = 0xcbf29ce484222325ULL;
+    int words = state->hires ? DISPLAY_WORDS : 1;
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++)
+    {
+        if (plane > 0 && planeBlank(state, plane))
+            continue;
+        for (int row = 0; row < chip8DisplayHeight(state); row++)
+        {
+            for (int w = 0; w < words; w++)
+            {
+                for (int shift = 56; shift >= 0; shift -= 8)
+                {
+                    hash ^= (state->display[plane][w][row] >> shift) & 0xFF;
+                    hash *= 0x100000001b3ULL;
+                }
+            }
+        }
+    }
+    return hash;
+}
+
+void chip8DumpState(const chip8_state* state, FILE* out)
+{
+    fprintf(out, "PC=%03x I=%03x SP=%x DT=%02x ST=%02x\n", state->pc, state->regI, state->stackPointer, state->delayTimer, state->soundTimer);
+    for (int i = 0; i < 16; i++)
+        fprintf(out, "V%X=%02x%s", i, state->regXY[i], (i % 8 == 7) ? "\n" : " ");
+    // plane 0, plane 1, both
+    static const char shades[4] = { '.', '#', 'o', '@' };
+    for (short row=0; row < chip8DisplayHeight(state); row++)
+    {
+        for (short col=0; col < chip8DisplayWidth(state); col++)
+            fputc(shades[chip8Pixel(state, col, row)], out);
+        fputc('\n', out);
+    }
+}
+
+static void initializeFont(unsigned char* ram_out)
+{
+    unsigned char font[16][5] = {
+        {0xF0, 0x90, 0x90, 0x90, 0xF0}, // 0
+        {0x20, 0x60, 0x20, 0x20, 0x70}, // 1
+        {0xF0, 0x10, 0xF0, 0x80, 0xF0}, // 2
+        {0xF0, 0x10, 0xF0, 0x10, 0xF0}, // 3
+        {0x90, 0x90, 0xF0, 0x10, 0x10}, // 4
+        {0xF0, 0x80, 0xF0, 0x10, 0xF0}, // 5
+        {0xF0, 0x80, 0xF0, 0x90, 0xF0}, // 6
+        {0xF0, 0x10, 0x20, 0x40, 0x40}, // 7
+        {0xF0, 0x90, 0xF0, 0x90, 0xF0}, // 8
+        {0xF0, 0x90, 0xF0, 0x10, 0xF0}, // 9
+        {0xF0, 0x90, 0xF0, 0x90, 0x90}, // A
+        {0xE0, 0x90, 0xE0, 0x90, 0xE0}, // B
+        {0xF0, 0x80, 0x80, 0x80, 0xF0}, // C
+        {0xE0, 0x90, 0x90, 0x90, 0xE0}, // D
+        {0xF0, 0x80, 0xF0, 0x80, 0xF0}, // E
+        {0xF0, 0x80, 0xF0, 0x80, 0x80}  // F
+    };
+    // SUPER-CHIP digits, extended to A-F as in XO-CHIP
+    unsigned char bigFont[16][10] = {
+        {0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF}, // 0
+        {0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF}, // 1
+        {0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF}, // 2
+        {0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF}, // 3
+        {0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03}, // 4
+        {0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF}, // 5
+        {0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF}, // 6
+        {0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18}, // 7
+        {0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF}, // 8
+        {0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF}, // 9
+        {0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3}, // A
+        {0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC}, // B
+        {0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C}, // C
+        {0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC}, // D
+        {0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF}, // E
+        {0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0}  // F
+    };
+    // font from 0x50 to 0x9F
+    unsigned short ram_index = FONT_ADDR;
+    for (int i = 0; i < 16; i++)
+    {
+        for (int j = 0; j < 5; j++)
+        {
+            ram_out[ram_index++] = font[i][j];
+        }
+    }
+    // big font from 0xA0 to 0x13F
+    memcpy(&ram_out[BIG_FONT_ADDR], bigFont, sizeof(bigFont));
+}
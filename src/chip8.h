@@ -0,0 +1,209 @@
+#ifndef CHIP8_H
+#define CHIP8_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define MEM_SIZE 4096
+#define START_ADDR 0x200
+#define FONT_ADDR 0x50
+#define BIG_FONT_ADDR 0xA0 // SUPER-CHIP 8x10 digits
+#define DISPLAY_W 64
+#define DISPLAY_H 32
+#define DISPLAY_HIRES_W 128 // SUPER-CHIP 00FF mode
+#define DISPLAY_HIRES_H 64
+#define DISPLAY_WORDS 2 // 64 column words per hires row
+#define DISPLAY_PLANES 2 // XO-CHIP bitplanes
+#define CODE_PAGE 64 // bytes per page tracked for translated code, MEM_SIZE / 64 pages
+
+// status returned by chip8Step/chip8Run
+#define CHIP8_OK 0
+#define CHIP8_HALT 1 // pc ran past the end of the ROM or hit 00FD EXIT
+#define CHIP8_FAULT 2 // the instruction at pc would break the machine, see state->fault
+
+// state->fault after CHIP8_FAULT. the faulting instruction does not execute and pc stays
+// on it, so running again faults again
+#define CHIP8_FAULT_STACK_OVERFLOW 1 // CALL with all 16 stack entries in use
+#define CHIP8_FAULT_STACK_UNDERFLOW 2 // RET with an empty stack
+#define CHIP8_FAULT_MEMORY 3 // DXYN, FX33, FX55 or FX65 reaching past the end of ram
+
+// no key available from the front end
+#define CHIP8_NO_KEY 0xff
+// host controls reported by pollKeys above the 16 keypad bits
+#define CHIP8_HOST_REWIND (1u << 16)
+
+// behaviours that differ between interpreters. a profile fixes all of them and runs on
+// its own copy of the interpreter specialized at compile time, so there are no quirk
+// tests on the execution path
+#define CHIP8_QUIRK_VF_RESET 0x01 // 8XY1/8XY2/8XY3 clear VF
+#define CHIP8_QUIRK_SHIFT_VX 0x02 // 8XY6/8XYE shift Vx in place instead of Vy into Vx
+#define CHIP8_QUIRK_KEEP_I 0x04 // FX55/FX65 leave I alone instead of advancing it past Vx
+#define CHIP8_QUIRK_WRAP 0x08 // DXYN wraps sprites around the screen edges instead of clipping
+#define CHIP8_QUIRK_JUMP_VX 0x10 // BXNN jumps to XNN + Vx instead of NNN + V0
+
+#define CHIP8_QUIRKS_CHIP8 (CHIP8_QUIRK_VF_RESET) // COSMAC VIP interpreter
+#define CHIP8_QUIRKS_SCHIP (CHIP8_QUIRK_SHIFT_VX | CHIP8_QUIRK_KEEP_I | CHIP8_QUIRK_JUMP_VX) // SUPER-CHIP 1.1
+#define CHIP8_QUIRKS_MODERN (CHIP8_QUIRK_SHIFT_VX | CHIP8_QUIRK_KEEP_I | CHIP8_QUIRK_WRAP) // the default
+
+typedef struct chip8_frontend chip8_frontend;
+typedef struct chip8_profile chip8_profile;
+typedef struct chip8_audio chip8_audio;
+typedef struct chip8_trace chip8_trace;
+typedef struct chip8_stream chip8_stream;
+
+// instruction handlers, one per distinct operation
+#define CHIP8_OPS(X) \
+    X(DECODE) /* entry not decoded yet */ \
+    X(CLS) X(RET) X(SYS) X(JP) X(CALL) \
+    X(SCD) X(SCU) X(SCR) X(SCL) X(EXIT) X(LOW) X(HIGH) /* SUPER-CHIP/XO-CHIP 00xx */ \
+    X(SE_VX_NN) X(SNE_VX_NN) X(SE_VX_VY) X(LD_VX_NN) X(ADD_VX_NN) \
+    X(LD_VX_VY) X(OR) X(AND) X(XOR) X(ADD_VX_VY) X(SUB) X(SHR) X(SUBN) X(SHL) \
+    X(SNE_VX_VY) X(LD_I) X(JP_V0) X(RND) X(DRW) X(SKP) X(SKNP) \
+    X(LD_VX_DT) X(LD_VX_K) X(LD_DT_VX) X(LD_ST_VX) X(ADD_I_VX) X(LD_F_VX) \
+    X(LD_B_VX) X(LD_MEM_VX) X(LD_VX_MEM) \
+    X(LD_HF_VX) X(LD_R_VX) X(LD_VX_R) X(PLANE) /* SUPER-CHIP FX30/FX75/FX85, XO-CHIP FN01 */ \
+    X(INVALID)
+
+#define CHIP8_OP_ENUM(name) CHIP8_OP_##name,
+enum chip8_op { CHIP8_OPS(CHIP8_OP_ENUM) CHIP8_OP_COUNT };
+
+// instruction decoded once into its handler and operands, nn is nnn & 0xFF
+typedef struct chip8_decoded
+{
+    unsigned char op;
+    unsigned char x;
+    unsigned char y;
+    unsigned char n;
+    unsigned short nnn;
+} chip8_decoded;
+
+
+// complete machine state of one emulator instance, no globals so any number can coexist
+typedef struct chip8_state
+{
+    unsigned char regXY[16];
+    unsigned short regI;
+    unsigned short pc;
+    unsigned char delayTimer;
+    unsigned char soundTimer;
+    unsigned short stack[16];
+    unsigned short stackPointer;
+    // packed bitplanes stored a word column at a time: display[plane][w][row] holds columns
+    // 64w to 64w+63 of row, bit 63 first. lores mode only uses word 0 of rows 0-31
+    uint64_t display[DISPLAY_PLANES][DISPLAY_WORDS][DISPLAY_HIRES_H];
+    unsigned char hires; // 128x64 after 00FF, 64x32 after 00FE
+    unsigned char planes; // planes DXYN, CLS and the scrolls act on, bit n for plane n
+    unsigned char flags[16]; // FX75/FX85 user flags
+    unsigned char ram[MEM_SIZE];
+
+    // decoded instruction starting at each ram address, reset to CHIP8_OP_DECODE
+    // whenever one of its two bytes is written
+    chip8_decoded decoded[MEM_SIZE];
+    // CODE_PAGE sized pages holding translated blocks (see jit.h), and those written since
+    uint64_t codePages;
+    uint64_t dirtyPages;
+
+    long int romSize;
+    unsigned char drawFlag; // display changed since the front end last drew it
+    uint16_t keys; // held hex keys, bit n for key n, read by EX9E/EXA1/FX0A
+    uint32_t rng; // xorshift32 state for CXNN, never 0
+    unsigned char quirks; // one of the CHIP8_QUIRKS_* profiles, see chip8SetQuirks
+    long long cycles; // instructions executed since chip8Init
+    long long idleCycles; // part of cycles fast-forwarded through delay timer wait loops
+    unsigned char fault; // CHIP8_FAULT_* of the last CHIP8_FAULT status, 0 if none since chip8Init
+    chip8_frontend* frontend;
+    chip8_profile* profile; // counters filled when built with CHIP8_PROFILE, see profile.h
+    chip8_audio* audio; // sound stage fed every timer tick, see audio.h. NULL beeps the front end
+    chip8_trace* trace; // execution trace written while set, see trace.h
+    chip8_stream* stream; // display changes written every timer tick while set, see stream.h
+} chip8_state;
+
+// pluggable front end, every hook must be set (see chip8NullFrontend for no-ops)
+struct chip8_frontend
+{
+    void (*open)(chip8_frontend* fe);
+    void (*close)(chip8_frontend* fe);
+    // present the display, called at most once per 60Hz frame when it changed
+    void (*draw)(chip8_frontend* fe, const chip8_state* state);
+    // drain pending input and return the held keys, bit n for hex key n plus CHIP8_HOST_*
+    // controls above them. called once per frame by the host loop, which stores the
+    // keypad bits in state->keys
+    uint32_t (*pollKeys)(chip8_frontend* fe);
+    void (*beep)(chip8_frontend* fe);
+    void* ctx;
+};
+
+// size of the current display mode
+static inline int chip8DisplayWidth(const chip8_state* state)
+{
+    return state->hires ? DISPLAY_HIRES_W : DISPLAY_W;
+}
+
+static inline int chip8DisplayHeight(const chip8_state* state)
+{
+    return state->hires ? DISPLAY_HIRES_H : DISPLAY_H;
+}
+
+// plane bits of the pixel at column x, row y, 0 if unlit
+static inline int chip8Pixel(const chip8_state* state, int x, int y)
+{
+    return (int)((state->display[0][x >> 6][y] >> (63 - (x & 63))) & 1)
+        | (int)(((state->display[1][x >> 6][y] >> (63 - (x & 63))) & 1) << 1);
+}
+
+extern chip8_frontend chip8NullFrontend;
+extern chip8_frontend chip8NcursesFrontend;
+
+// terminal cells written by the ncurses front end, which only redraws cells that changed
+typedef struct chip8_render_stats
+{
+    long long frames; // presents
+    long long cells; // cells written over all presents
+    int lastFrameCells;
+} chip8_render_stats;
+
+const chip8_render_stats* chip8NcursesStats(void);
+// how long a key stays held after its last character, terminals send no release events
+void chip8NcursesSetKeyRelease(int ms);
+
+#define CHIP8_DEFAULT_SEED 0x2545f491u
+
+// reset registers, ram and display, load the font, seed RND with CHIP8_DEFAULT_SEED and
+// select CHIP8_QUIRKS_MODERN
+void chip8Init(chip8_state* state, chip8_frontend* frontend);
+// select a CHIP8_QUIRKS_* profile, returns -1 for any other mask
+int chip8SetQuirks(chip8_state* state, unsigned int quirks);
+// profile mask for "chip8", "schip" or "modern", -1 for any other name
+int chip8QuirksByName(const char* name);
+// reseed RND, the same seed replays the same CXNN values
+void chip8Seed(chip8_state* state, uint32_t seed);
+// load a ROM at START_ADDR, returns its size or -1 if it cannot be read
+long int chip8LoadRom(chip8_state* state, const char* rom_in);
+long int chip8LoadRomBuffer(chip8_state* state, const unsigned char* rom, long int size);
+// call after writing state->ram directly so stale decoded instructions are dropped
+void chip8InvalidateCode(chip8_state* state, unsigned short addr, int len);
+// decode inst into its handler and operands
+void chip8Decode(unsigned short inst, chip8_decoded* out);
+// execute a single instruction
+int chip8Step(chip8_state* state);
+// execute up to cycles instructions, stops early if the ROM halts
+int chip8Run(chip8_state* state, long long cycles);
+// execute up to cycles instructions at full speed, ticking the timers every tickInsts instructions
+int chip8RunTicked(chip8_state* state, long long cycles, int tickInsts);
+// nonzero if pc holds the FX07 of a delay timer wait loop (FX07; 3XNN/4XNN; JP back to
+// the FX07) whose exit test fails for the current timer value, so it spins until the next tick
+int chip8IdleLoop(chip8_state* state, unsigned short pc);
+// 60Hz tick of the delay and sound timers, passing the tone state to the audio stage
+// and the display to the frame stream
+void chip8TickTimers(chip8_state* state);
+// name of a CHIP8_FAULT_* value
+const char* chip8FaultName(int fault);
+// FNV-1a hash of the display contents
+unsigned long long chip8DisplayHash(const chip8_state* state);
+// print registers and an ASCII copy of the display
+void chip8DumpState(const chip8_state* state, FILE* out);
+
+// write the mnemonic for inst into out
+void chip8Disassemble(unsigned short inst, char* out, int outLen);
+
+#endif
@@ -1,613 +1,744 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <string.h>
 #include <ncurses.h>
 #include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
 
-#define MEM_SIZE 4096
-#define START_ADDR 0x200
+#include "chip8.h"
+#include "batch.h"
+#include "pool.h"
+#include "jit.h"
+#include "sched.h"
+#include "savestate.h"
+#include "rewind.h"
+#include "replay.h"
+#include "profile.h"
+#include "cfg.h"
+#include "lockstep.h"
+#include "audio.h"
+#include "trace.h"
+#include "stream.h"
 
-long int loadRom(char* rom_in, unsigned char* ram_out, long int start_addr, long int max_size);
-void execute(char* rom_in, int disFlag);
-void initializeFont(unsigned char* ram_out);
-unsigned char convertKey(int keyIn);
+#define TICK_INSTS 8 // instructions per 60Hz timer tick, roughly 500Hz
+#define MAX_CATCHUP 4 // frames run back to back when late before the rest are dropped
+#define REWIND_KB 2048 // default rewind buffer, minutes of typical frames
+#define REWIND_KEY_FRAMES 60 // frames per rewind keyframe
+
+// command line settings for a single ROM run
+typedef struct run_options
+{
+    int headless;
+    int useJit;
+    long long cycleBudget;
+    double timeBudget;
+    int tickInsts;
+    uint32_t seed; // 0 for one from the clock
+    char* saveOut; // snapshot written at the end
+    long rewindKB;
+    char* recordPath; // input log written by an interactive run
+    char* replayPath; // input log rerun headless
+    char* profilePrefix; // <prefix>.json and <prefix>.folded written at the end
+    int quirks; // CHIP8_QUIRKS_* profile, -1 for the default or a snapshot's own
+    char* audioPath; // sound written as WAV or raw PCM
+    char* tracePath; // execution trace written during the run
+    char* streamPath; // display frames streamed during the run
+    int sampleRate;
+} run_options;
+
+void disassemble(char* rom_in, int dot);
+int batch(int argc, char** argv);
+int analyze(int argc, char** argv);
+int ensemble(int argc, char** argv);
+int compareTraces(int argc, char** argv);
+int convertFrames(int argc, char** argv);
+void execute(char* rom_in, const run_options* opts);
+double elapsedSeconds(struct timespec* start);
+uint32_t clockSeed(void);
+void writeProfile(const chip8_profile* profile, const char* prefix);
 
 void main(int argc, char**argv)
 {
     // process command line options
-    // [-d] <rom_file>: Execute ROM, if -d is present then disassemble instead 
-    if (argc == 3 && !strcmp(argv[1], "-d"))
+    // [-d] [-k <insts>] [-r <ms>] [-m <KB>] [-i <log>] <rom_file>: Execute ROM at <insts> instructions
+    //   per 60Hz frame, keys count as held for <ms> after their last keypress, backspace steps back
+    //   through a <KB> rewind buffer, -i records the keys of every frame to <log>, if -d is present
+    //   then disassemble instead, following control flow from the entry point, -g as a DOT graph
+    // [-n <cycles>] [-t <seconds>] [-k <insts>] [-x] <rom_file>: run headless (no ncurses, no pacing)
+    //   until the ROM ends or the instruction/wall-clock budget is used up, ticking
+    //   the timers every <insts> instructions, -x runs through the block translator
+    // [-x] -p <log> <rom_file>: rerun a recorded session headless and check its display hashes
+    // -s <seed> in either mode seeds RND so a run can be replayed, the default comes from the clock
+    //   or a snapshot. -w <file> writes a snapshot of the final state, which can be run in place of
+    //   the ROM to resume from it. -P <prefix> writes an execution profile when built with CHIP8_PROFILE
+    //   -q <chip8|schip|modern> selects the quirks profile (default modern, or a snapshot's)
+    //   -T <file> writes an execution trace, -c <trace> [<trace>] lists one or diffs two
+    //   -A <file> captures the sound as PCM at -R <rate> samples/sec, WAV if the name ends in .wav
+    //   -F <file> streams the changed display rows of every frame, -V <stream> <out> [<first> [<count>]]
+    //   converts a stream to PGM or GIF
+    int disFlag = 0;
+    int dotFlag = 0;
+    run_options opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.tickInsts = TICK_INSTS;
+    opts.rewindKB = REWIND_KB;
+    opts.quirks = -1;
+    opts.sampleRate = AUDIO_DEFAULT_RATE;
+    int argi;
+    if (argc > 2 && !strcmp(argv[1], "-b"))
+    {
+        if (batch(argc, argv) == 0)
+            return;
+        argc = 0; // fall through to usage
+    }
+    if (argc > 2 && !strcmp(argv[1], "-a"))
+    {
+        if (analyze(argc, argv) == 0)
+            return;
+        argc = 0;
+    }
+    if (argc > 2 && !strcmp(argv[1], "-c"))
+    {
+        if (compareTraces(argc, argv) == 0)
+            return;
+        argc = 0;
+    }
+    if (argc > 3 && !strcmp(argv[1], "-V"))
     {
-        // disassemble option
-        execute(argv[2], 1);
+        if (convertFrames(argc, argv) == 0)
+            return;
+        argc = 0;
     }
-    else if (argc == 2)
+    if (argc > 3 && !strcmp(argv[1], "-e"))
     {
-        // execute
-        execute(argv[1], 0);
+        if (ensemble(argc, argv) == 0)
+            return;
+        argc = 0;
+    }
+    for (argi = 1; argi < argc-1; argi++)
+    {
+        if (!strcmp(argv[argi], "-d"))
+            disFlag = 1;
+        else if (!strcmp(argv[argi], "-g"))
+            dotFlag = disFlag = 1;
+        else if (!strcmp(argv[argi], "-n") && argi+1 < argc-1)
+        {
+            opts.headless = 1;
+            opts.cycleBudget = atoll(argv[++argi]);
+        }
+        else if (!strcmp(argv[argi], "-t") && argi+1 < argc-1)
+        {
+            opts.headless = 1;
+            opts.timeBudget = atof(argv[++argi]);
+        }
+        else if (!strcmp(argv[argi], "-k") && argi+1 < argc-1)
+            opts.tickInsts = atoi(argv[++argi]);
+        else if (!strcmp(argv[argi], "-x"))
+            opts.useJit = 1;
+        else if (!strcmp(argv[argi], "-s") && argi+1 < argc-1)
+            opts.seed = (uint32_t) strtoul(argv[++argi], NULL, 0);
+        else if (!strcmp(argv[argi], "-w") && argi+1 < argc-1)
+            opts.saveOut = argv[++argi];
+        else if (!strcmp(argv[argi], "-m") && argi+1 < argc-1)
+            opts.rewindKB = atol(argv[++argi]);
+        else if (!strcmp(argv[argi], "-r") && argi+1 < argc-1)
+            chip8NcursesSetKeyRelease(atoi(argv[++argi]));
+        else if (!strcmp(argv[argi], "-q") && argi+1 < argc-1 && (opts.quirks = chip8QuirksByName(argv[argi+1])) >= 0)
+            argi++;
+        else if (!strcmp(argv[argi], "-P") && argi+1 < argc-1)
+            opts.profilePrefix = argv[++argi];
+        else if (!strcmp(argv[argi], "-T") && argi+1 < argc-1)
+            opts.tracePath = argv[++argi];
+        else if (!strcmp(argv[argi], "-A") && argi+1 < argc-1)
+            opts.audioPath = argv[++argi];
+        else if (!strcmp(argv[argi], "-F") && argi+1 < argc-1)
+            opts.streamPath = argv[++argi];
+        else if (!strcmp(argv[argi], "-R") && argi+1 < argc-1)
+            opts.sampleRate = atoi(argv[++argi]);
+        else if (!strcmp(argv[argi], "-i") && argi+1 < argc-1)
+            opts.recordPath = argv[++argi];
+        else if (!strcmp(argv[argi], "-p") && argi+1 < argc-1)
+        {
+            opts.headless = 1;
+            opts.replayPath = argv[++argi];
+        }
+        else
+            break;
+    }
+
+    if (argc > 0 && argi == argc-1 && opts.tickInsts > 0 && opts.sampleRate > 0 && !(disFlag && opts.headless) && (opts.headless || !opts.useJit)
+        && !(opts.recordPath && opts.headless))
+    {
+        if (disFlag)
+            disassemble(argv[argi], dotFlag);
+        else
+            execute(argv[argi], &opts);
     }
     else
     {
-         printf("Usage: %s [-d] <rom_file>: specify -d to disassemble instead of execute.\n", argv[0]);
+         printf("Usage: %s [-d] [-k <insts>] [-r <ms>] [-m <KB>] [-i <log>] <rom_file>: specify -d to disassemble instead of execute.\n", argv[0]);
+         printf("       -d follows jumps, calls and skips from the entry point and lists code by basic block, the\n");
+         printf("       rest as data, plus the call graph; -g writes the control flow graph as Graphviz DOT instead.\n");
+         printf("       runs <insts> instructions per 60Hz frame (default %d) and reports frame jitter on exit,\n", TICK_INSTS);
+         printf("       a key stays held for <ms> after its last keypress (default 150). Hold backspace to rewind\n");
+         printf("       through the last <KB> of frames (default %d, 0 disables). -i records the session's input to <log>.\n", REWIND_KB);
+         printf("       %s [-n <cycles>] [-t <seconds>] [-k <insts>] [-x] <rom_file>: run headless at full speed\n", argv[0]);
+         printf("       for at most <cycles> instructions and/or <seconds> of wall time, ticking timers\n");
+         printf("       every <insts> instructions (default %d); prints instructions/sec and final state.\n", TICK_INSTS);
+         printf("       -x runs through the block translator and also reports its block cache hit rate.\n");
+         printf("       %s [-x] -p <log> <rom_file>: replay a recorded session headless at full speed and verify it.\n", argv[0]);
+         printf("       -s <seed> seeds RND for a reproducible run in either mode (default: from the clock).\n");
+         printf("       -q <chip8|schip|modern> picks the quirks profile: shifts, FX55/FX65 I, DRW wrap, BNNN (default modern).\n");
+         printf("       -w <file> saves a snapshot of the final state; pass a snapshot instead of a ROM to resume it.\n");
+         printf("       -T <file> writes a compressed trace of every instruction run (through the interpreter).\n");
+         printf("       %s -c <trace> [<trace>]: list a trace, or report where two traces first diverge.\n", argv[0]);
+         printf("       -F <file> streams the rows of the display that changed each frame (a pipe works too).\n");
+         printf("       %s -V <stream> <out> [<first> [<count>]]: convert a frame stream to an animated GIF for a .gif\n", argv[0]);
+         printf("       <out>, one PGM per frame if <out> holds a %%d for the frame number, else a single PGM stream.\n");
+         printf("       -A <file> writes the sound as 16 bit PCM at -R <rate> samples/sec (default %d), WAV for a .wav\n", AUDIO_DEFAULT_RATE);
+         printf("       name and raw otherwise; interactive runs without it ring the terminal bell as a tone starts.\n");
+         printf("       -P <prefix> writes <prefix>.json and <prefix>.folded profiles (build with -DCHIP8_PROFILE).\n");
+         printf("       %s -b <cycles> [-j <threads>] [-k <insts>] [-o <file>] [-F <dir>] <rom|dir|@list>...: run every ROM\n", argv[0]);
+         printf("       headless for <cycles> instructions in parallel and write a per-ROM summary, -F streams frames to <dir>.\n");
+         printf("       %s -a [-j <threads>] [-g] [-o <dir>] <rom|dir|@list>...: disassemble every ROM as -d (-g)\n", argv[0]);
+         printf("       does in parallel, into <dir>/<rom>.asm (.dot) with a per-ROM summary, or in order to stdout.\n");
+         printf("       %s -e <lanes> <frames> [-j <threads>] [-k <insts>] [-q <quirks>] [-s <seed>] <rom_file>: run\n", argv[0]);
+         printf("       <lanes> copies of a ROM in lockstep for <frames> frames, lane i seeded <seed>+i and holding\n");
+         printf("       key i%%17 (none for 16), report lane frames/sec and check a few lanes against the interpreter.\n");
     }
 }
 
-void execute(char* rom_in, int disFlag)
+int batch(int argc, char** argv)
 {
-    // initialize registers
-    unsigned char regXY[16];
-    memset(regXY, 0, sizeof(regXY));
-    unsigned short regI = 0;
-    unsigned short pc = 0;
-    unsigned char delayTimer = 0;
-    unsigned char soundTimer = 0;
-    unsigned short stack[16];
-    memset(stack, 0, sizeof(stack));
-    unsigned short stackPointer = 0;
-    
-    unsigned short ticks = 0; // use for timer ticks
-
-    // initialize display
-    char display[64][32];
-    memset(display, 0, sizeof(display));
-    if (!disFlag) initscr();
-    if (!disFlag) curs_set(0);
-    if (!disFlag) noecho();
-
-    // initialize ram
-    unsigned char ram[MEM_SIZE];
-    memset(ram, 0, MEM_SIZE);
-    
-    // load rom
-    long int rom_size = 0;
-    rom_size = loadRom(rom_in, ram, START_ADDR, MEM_SIZE); 
-    
-    // initialize font
-    initializeFont(ram);
-
-    // fetch/decode/execute
-    for (pc = START_ADDR; pc < rom_size+START_ADDR; pc+=2)
-    {
-        unsigned short inst = (((unsigned short)ram[pc]) << 8) | ((unsigned short)ram[pc+1]);
-
-        unsigned short opcode = (inst&0xF000)>>12;
-        unsigned short regX = (inst&0x0F00)>>8;
-        unsigned short regY = (inst&0x00F0)>>4;
-        unsigned short valN = (inst&0x000F);
-        unsigned short valNN = (inst&0x00FF);
-        unsigned short valNNN = (inst&0x0FFF);
-
-        if (disFlag) printf("%4x [%04x]: ", pc, inst);
-        switch (opcode)
-        {
-            case 0x0:
-                switch (valNN)
-                {
-                    case 0xE0:
-                        if (disFlag) printf("CLS");
-                        else
-                        {
-                            memset(display, 0, sizeof(display));
-                            clear();
-                        }
-                        break;
-
-                    case 0xEE:
-                        if (disFlag) printf("RET");
-                        else
-                        {
-                            pc = stack[--stackPointer] -2; // because auto increment
-                        }
-                        break;
-
-                    default: // 0x0nnn
-                        if (disFlag) printf("SYS %03x", valNNN);
-                        // not implementing
-                        break;
-                }
-                break;
-            case 0x1:
-                if (disFlag) printf("JP %03x", valNNN);
-                else
-                {
-                    pc = valNNN - 2; // loop will auto increment by 2 so offset
-                }
-                break;
-            case 0x2:
-                if (disFlag) printf("CALL %03x", valNNN);
-                else
-                {
-                    stack[stackPointer++] = pc + 2;
-                    pc = valNNN - 2; // compensate auto increment
-                }
-                break;
-            case 0x3:
-                if (disFlag) printf("SE V%x, %02x", regX, valNN);
-                else
-                {
-                    
-                    //printf("%x == %x: %x\n", regXY[regX], valNN, regXY[regX]== valNN);
-                    //getch();
-                    if (regXY[regX] == valNN)
-                        pc += 2;
-                }
-                break;
-            case 0x4:
-                if (disFlag) printf("SNE V%x, %02x", regX, valNN);
-                else
-                {
-                    if (regXY[regX] != (unsigned char) valNN)
-                        pc += 2;
-                }
-                break;
-            case 0x5:
-                if (disFlag) printf("SE V%x, V%x", regX, regY);
-                else
-                {
-                    if (regXY[regX] == regXY[regY])
-                        pc+=2;
-                }
-                break;
-            case 0x6:
-                if (disFlag) printf("LD V%x, %02x", regX, valNN);
-                else
-                {
-                    regXY[regX] = valNN;
-                }
-                break;
-            case 0x7:
-                if (disFlag) printf("ADD V%x, %02x", regX, valNN);
-                else
-                {
-                    regXY[regX] += valNN;
-                }
-                break;
-            case 0x8:
-                switch (valN)
-                {
-                    case 0x0:
-                        if (disFlag) printf("LD V%x, V%x", regX, regY);
-                        else
-                        {
-                            regXY[regX] = regXY[regY];
-                        }
-                        break;
-                    case 0x1:
-                        if (disFlag) printf("OR V%x, V%x", regX, regY);
-                        else
-                        {
-                            regXY[regX] |= regXY[regY];
-                        }
-                        break;
-                    case 0x2:
-                        if (disFlag) printf("AND V%x, V%x", regX, regY);
-                        else
-                        {
-                            regXY[regX] &= regXY[regY];
-                        }
-                        break;
-                    case 0x3:
-                        if (disFlag) printf("XOR V%x, V%x", regX, regY);
-                        else
-                        {
-                            regXY[regX] ^= regXY[regY];
-                        }
-                        break;
-                    case 0x4:
-                        if (disFlag) printf("ADD V%x, V%x", regX, regY);
-                        else
-                        {
-                            unsigned short temp = (unsigned short) regXY[regX] + (unsigned short) regXY[regY];
-                            // check carry
-                            regXY[0xF] = ((temp >> 8) > 0);
-
-                            regXY[regX] = (unsigned char) (temp & 0xFF);
-                        }
-                        break;
-                    case 0x5:
-                        if (disFlag) printf("SUB V%x, V%x", regX, regY);
-                        else
-                        {
-                            regXY[0xF] = (regXY[regX] > regXY[regY]);
-                            regXY[regX] -= regXY[regY];
-                        }
-                        break;
-                    case 0x6:
-                        if (disFlag) printf("SHR V%x {, V%x}", regX, regY);
-                        else
-                        {
-                            // implementing to ignore loading regY
-                            
-                            // check carry
-                            regXY[0xF] = regXY[regX] & 0x01;
-                            regXY[regX] >>= 1;
-                        }
-                        break;
-                    case 0x7:
-                        if (disFlag) printf("SUBN V%x, V%x", regX, regY);
-                        else
-                        {
-                            regXY[0xF] = (regXY[regY] > regXY[regX]);
-                            regXY[regX] = regXY[regY] - regXY[regX];
-                        }
-                        break;
-                    case 0xE:
-                        if (disFlag) printf("SHL V%x {, V%x}", regX, regY);
-                        else
-                        {
-                            //implementing to ignore loading regY
-
-                            // check carry
-                            regXY[0xF] = (regXY[regX] & 0x80) >> 7;
-                            regXY[regX] <<= 1;
-                        }
-                        break;
-                    default:
-                        if (disFlag) printf("not supported");
-                }
-                break;
-            case 0x9:
-                if (disFlag) printf("SNE V%x, V%x", regX, regY);
-                else
-                {
-                    if (regXY[regX] != regXY[regY])
-                        pc += 2;
-                }
-                break;
-            case 0xA:
-                if (disFlag) printf("LD I, %03x", valNNN);
-                else
-                {
-                    regI = valNNN;
-                }
-                break;
-            case 0xB:
-                if (disFlag) printf("JP V0, %03x", valNNN);
-                else
-                {
-                    pc = valNNN + regXY[0] - 2; //compensate for autoinc
-                }
-                break;
-            case 0xC:
-                if (disFlag) printf("RND V%x, %02x", regX, valNN);
-                else
-                {
-                    time_t t;
-                    srand((unsigned)time(&t));
-                    unsigned char random = (unsigned char)(rand() % 0xFF);
-                    regXY[regX] = random & valNN;
-                }
-                break;
-            case 0xD:
-                if (disFlag) printf("DRW V%x, V%x, %x", regX, regY, valN);
-                else
-                {
-                    //timeout(-1);
-                    //getch();
-                    // get x value from reg[regX] % 64
-                    unsigned char x = regXY[regX] % 64;
-                    // get y value from reg[regY] % 32
-                    unsigned char y = regXY[regY] % 32;
-                    // reg[VF]=0
-                    regXY[0xF] = 0;
-                    // for i in valN rows
-                    for (int i = 0; i < valN; i++)
-                    {
-                        unsigned char byte = ram[regI+i];
-                        // for bit in byte
-                        for (int j = 0; j < 8; j++)
-                        {
-                            unsigned char bit = (byte >> (7-j)) & 0x01;
-                            if (bit == 1 && display[x][y] == 1)
-                            {
-                                display[x][y] = 0;
-                                regXY[0xF] = 1;
-                            }
-                            else if (bit == 1 && display[x][y] == 0)
-                            {
-                                display[x][y] = 1;
-                            }
-                            x++;
-                            x = x % 64;
-                            //if (x > 64) break;
-                        }
-                        x = regXY[regX] % 64;
-                        y++;
-                        y = y % 32;
-                        //if (y > 32) break;
-                    }
-                    clear();
-                    for (short row=0; row < 32; row++)
-                    {
-                        for (short col=0; col < 64; col++)
-                        {
-                            if (display[col][row])
-                                mvaddch(row, col, ACS_CKBOARD);
-                        }
-                    }
-                    refresh();
-                    //timeout(-1);
-                    //getch();
-                }
-                break;
-            case 0xE:
-                switch (valNN)
-                {
-                    case 0x9E:
-                        if (disFlag) printf("SKP V%x", regX);
-                        else
-                        {
-                            // check what key is pressed
-                            timeout(0);
-                            int c = getch();
-                            // map to hexadecimal keypad
-                            unsigned char hdkey = convertKey(c);
-                            // compare reg[vx] to hexadecimal keypad value
-                            if (hdkey != 0xff)
-                            {
-                                if (regXY[regX] == hdkey)
-                                    pc += 2;
-                            }
-                        }
-                        break;
-                    case 0xA1:
-                        if (disFlag) printf("SKNP V%x", regX);
-                        else
-                        {
-                            // check what key is pressed
-                            timeout(0);
-                            int c = getch();
-                            //map to hexadecimal keypad
-                            unsigned char hdkey = convertKey(c);
-                            // compare reg[vx] to keypad
-                            if (regXY[regX] != hdkey)
-                                pc += 2;
-                        }
-                        break;
-                    default:
-                        if (disFlag) printf("not supported");
-                        break;
-                }
-                break;
-            case 0xF:
-                switch (valNN)
-                {
-                    case 0x07:
-                        if (disFlag) printf("LD V%x, DT", regX);
-                        else
-                        {
-                            regXY[regX] = delayTimer;
-                        }
-                        break;
-                    case 0x0A:
-                        if (disFlag) printf("LD V%x, K", regX);
-                        else
-                        {
-                            timeout(-1);
-                            int c = getch();
-                            unsigned char hdkey = convertKey(c);
-                            regXY[regX] = hdkey;
-                        }
-                        break;
-                    case 0x15:
-                        if (disFlag) printf("LD DT, V%x", regX);
-                        else
-                        {
-                            delayTimer = regXY[regX];
-                        }
-                        break;
-                    case 0x18:
-                        if (disFlag) printf("LD ST, V%x", regX);
-                        else
-                        {
-                            soundTimer = regXY[regX];
-                        }
-                        break;
-                    case 0x1E:
-                        if (disFlag) printf("ADD I, V%x", regX);
-                        else
-                        {
-                            regI += regXY[regX];
-                        }
-                        break;
-                    case 0x29:
-                        if (disFlag) printf("LD F, V%x", regX);
-                        else
-                        {
-                            regI = 0x50 + regXY[regX] * 5;
-                        }
-                        break;
-                    case 0x33:
-                        if (disFlag) printf("LD B, V%x", regX);
-                        else
-                        {
-                            unsigned char num = regXY[regX];
-                            // store 100s
-                            unsigned char huns = num / 100;
-                            ram[regI] = huns;
-                            // store 10s
-                            unsigned char tens = (num - (huns*100)) / 10;
-                            ram[regI+1] = tens;
-                            // store 1s
-                            unsigned char ones = (num - ((huns*100)+(tens*10)));
-                            ram[regI+2] = ones;
-                        }
-                        break;
-                    case 0x55:
-                        if (disFlag) printf("LD [I], V%x", regX);
-                        else
-                        {
-                            for (int i = 0; i <= regX; i++)
-                            {
-                                ram[regI+i] = regXY[i];
-                            }
-                        }
-                        break;
-                    case 0x65:
-                        if (disFlag) printf("LD V%x, [I]", regX);
-                        else
-                        {
-                            for (int i = 0; i <= regX; i++)
-                            {
-                                regXY[i] = ram[regI+i];
-                            }
-                        }
-                        break;
-                    default:
-                        if (disFlag) printf("not supported");
-                        break;
-                }
-                break;
-            default:
-                if (disFlag) printf("not supported");
-                break;
-        }
-        if (disFlag) printf("\n");
-        else
+    // -b <cycles> [-j <threads>] [-k <insts>] [-o <file>] [-F <dir>] <rom|dir|@list>...
+    long long cycles = atoll(argv[2]);
+    int threads = poolDefaultThreads();
+    int tickInsts = TICK_INSTS;
+    char* outName = NULL;
+    char* streamDir = NULL;
+    char** roms = NULL;
+    int count = 0;
+    for (int argi = 3; argi < argc; argi++)
+    {
+        if (!strcmp(argv[argi], "-j") && argi+1 < argc)
+            threads = atoi(argv[++argi]);
+        else if (!strcmp(argv[argi], "-k") && argi+1 < argc)
+            tickInsts = atoi(argv[++argi]);
+        else if (!strcmp(argv[argi], "-o") && argi+1 < argc)
+            outName = argv[++argi];
+        else if (!strcmp(argv[argi], "-F") && argi+1 < argc)
+            streamDir = argv[++argi];
+        else if (batchCollect(argv[argi], &roms, &count) < 0)
+            printf("invalid ROM source: %s\n", argv[argi]);
+    }
+    if (cycles <= 0 || tickInsts <= 0 || count == 0)
+        return -1;
+
+    FILE* out = outName ? fopen(outName, "w") : stdout;
+    if (out == NULL)
+    {
+        printf("cannot write %s\n", outName);
+        return -1;
+    }
+
+    batch_result* results = calloc(count, sizeof(batch_result));
+    struct timespec startTime;
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    batchRun(roms, count, cycles, tickInsts, threads, streamDir, results);
+    batchPrint(results, count, elapsedSeconds(&startTime), out);
+
+    if (out != stdout)
+        fclose(out);
+    for (int i = 0; i < count; i++)
+        free(roms[i]);
+    free(roms);
+    free(results);
+    return 0;
+}
+
+int analyze(int argc, char** argv)
+{
+    // -a [-j <threads>] [-g] [-o <dir>] <rom|dir|@list>...
+    int threads = poolDefaultThreads();
+    int dot = 0;
+    char* outDir = NULL;
+    char** roms = NULL;
+    int count = 0;
+    for (int argi = 2; argi < argc; argi++)
+    {
+        if (!strcmp(argv[argi], "-j") && argi+1 < argc)
+            threads = atoi(argv[++argi]);
+        else if (!strcmp(argv[argi], "-g"))
+            dot = 1;
+        else if (!strcmp(argv[argi], "-o") && argi+1 < argc)
+            outDir = argv[++argi];
+        else if (batchCollect(argv[argi], &roms, &count) < 0)
+            printf("invalid ROM source: %s\n", argv[argi]);
+    }
+    if (count == 0)
+        return -1;
+
+    cfg_result* results = calloc(count, sizeof(cfg_result));
+    cfgRunCorpus(roms, count, threads, dot, outDir, results);
+    // listings come back in memory so they print in ROM order whatever thread made them
+    for (int i = 0; i < count; i++)
+    {
+        if (results[i].text)
         {
-            // wait to emulate processing speed
-            napms(2); // roughly 500Hz
-            
-            // update timers
-            if (ticks == 7) // roughly 60Hz (8 ticks)
-            {
-                if (delayTimer > 0)
-                    delayTimer--;
-                if (soundTimer > 0)
-                {
-                    beep();
-                    soundTimer--;
-                }
-                ticks = 0;
-            }
-            else
-            {
-                ticks++;
-            }
+            if (count > 1 && !dot)
+                printf("; ==== %s\n", results[i].rom);
+            fwrite(results[i].text, 1, results[i].size, stdout);
+            free(results[i].text);
         }
+        else if (!outDir)
+            printf("cannot read %s\n", results[i].rom);
     }
-    endwin();
-}
+    if (outDir)
+        cfgPrintSummary(results, count, stdout);
 
+    for (int i = 0; i < count; i++)
+        free(roms[i]);
+    free(roms);
+    free(results);
+    return 0;
+}
 
-long int loadRom(char* rom_in, unsigned char* ram_out, long int start_addr, long int max_size)
+int ensemble(int argc, char** argv)
 {
-    // open file
-    FILE *romPtr = fopen(rom_in, "rb");
-    if (romPtr == NULL)
+    // -e <lanes> <frames> [-j <threads>] [-k <insts>] [-q <quirks>] [-s <seed>] <rom_file>
+    int lanes = atoi(argv[2]);
+    long long frames = atoll(argv[3]);
+    int threads = poolDefaultThreads();
+    int tickInsts = TICK_INSTS;
+    int quirks = CHIP8_QUIRKS_MODERN;
+    uint32_t seed = CHIP8_DEFAULT_SEED;
+    char* rom_in = NULL;
+    for (int argi = 4; argi < argc; argi++)
+    {
+        if (!strcmp(argv[argi], "-j") && argi+1 < argc)
+            threads = atoi(argv[++argi]);
+        else if (!strcmp(argv[argi], "-k") && argi+1 < argc)
+            tickInsts = atoi(argv[++argi]);
+        else if (!strcmp(argv[argi], "-q") && argi+1 < argc)
+            quirks = chip8QuirksByName(argv[++argi]);
+        else if (!strcmp(argv[argi], "-s") && argi+1 < argc)
+            seed = strtoul(argv[++argi], NULL, 0);
+        else
+            rom_in = argv[argi];
+    }
+    if (lanes <= 0 || frames <= 0 || tickInsts <= 0 || quirks < 0 || rom_in == NULL)
+        return -1;
+
+    static chip8_state state;
+    chip8Init(&state, NULL);
+    long int rom_size = chip8LoadRom(&state, rom_in);
+    if (rom_size < 0)
+    {
+        printf("cannot read %s\n", rom_in);
+        return 0;
+    }
+    chip8_lockstep* ls = lockstepCreate(lanes, &state.ram[START_ADDR], rom_size, quirks, threads);
+    if (ls == NULL)
     {
-        printf("invalid file: %s\n", rom_in);
+        printf("cannot allocate %d lanes\n", lanes);
+        return 0;
     }
+    uint16_t* keys = malloc(lanes * sizeof(uint16_t));
+    for (int lane = 0; lane < lanes; lane++)
+        keys[lane] = lane % 17 < 16 ? 1 << (lane % 17) : 0;
+    lockstepReset(ls, NULL, seed);
+    lockstepSetKeys(ls, keys);
 
-    // determine ROM size
-    long int rom_size = 0;
-    fseek(romPtr, 0, SEEK_END);
-    rom_size = ftell(romPtr);
-    rewind(romPtr);
-    if (rom_size > (max_size-start_addr))
+    struct timespec startTime;
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    for (long long f = 0; f < frames; f++)
+        lockstepStep(ls, tickInsts);
+    double seconds = elapsedSeconds(&startTime);
+
+    lockstep_stats stats;
+    lockstepStats(ls, &stats);
+    unsigned char* status = malloc(lanes);
+    lockstepObserve(ls, NULL, status);
+    int halted = 0, faulted = 0, unsupported = 0;
+    for (int lane = 0; lane < lanes; lane++)
     {
-	    printf("ROM is larger than RAM, only reading first %d bytes", max_size);
-	    rom_size = (max_size-start_addr);
+        halted += status[lane] == CHIP8_HALT;
+        faulted += status[lane] == CHIP8_FAULT;
+        unsupported += status[lane] == LOCKSTEP_UNSUPPORTED;
     }
+    printf("%d lanes x %lld frames in %.3fs: %.0f lane frames/sec, %.2f MIPS\n", lanes, frames, seconds,
+        seconds > 0 ? stats.frames / seconds : 0.0, seconds > 0 ? stats.insts / seconds / 1e6 : 0.0);
+    printf("%.2f lanes per issued instruction, %.1f%% of lane instructions masked, %d halted, %d faulted, %d unsupported\n",
+        stats.groupSteps ? (double) stats.insts / stats.groupSteps : 0.0,
+        stats.insts ? 100.0 * stats.vectorLanes / stats.insts : 0.0, halted, faulted, unsupported);
 
-    //read in
-    for (int i = start_addr; i < (rom_size+start_addr); i++)
+    // the first, middle and last lanes against the interpreter on the same seed and keys
+    static chip8_state lane;
+    int checks[3] = { 0, lanes / 2, lanes - 1 };
+    for (int c = 0; c < 3; c++)
+    {
+        int i = checks[c];
+        if (status[i] == LOCKSTEP_UNSUPPORTED || (c > 0 && i == checks[c-1]))
+            continue;
+        chip8Init(&state, NULL);
+        chip8SetQuirks(&state, quirks);
+        chip8LoadRom(&state, rom_in);
+        chip8Seed(&state, seed + i);
+        state.keys = keys[i];
+        chip8RunTicked(&state, frames * tickInsts, tickInsts);
+        lockstepExport(ls, i, &lane);
+        int match = state.pc == lane.pc && state.regI == lane.regI && !memcmp(state.regXY, lane.regXY, 16)
+            && !memcmp(state.ram, lane.ram, MEM_SIZE) && state.delayTimer == lane.delayTimer
+            && chip8DisplayHash(&state) == chip8DisplayHash(&lane);
+        printf("lane %d: pc %03X display %016llx %s\n", i, lane.pc, chip8DisplayHash(&lane),
+            match ? "matches the interpreter" : "DIFFERS from the interpreter");
+    }
+
+    free(status);
+    free(keys);
+    lockstepDestroy(ls);
+    return 0;
+}
+
+int compareTraces(int argc, char** argv)
+{
+    // -c <trace> [<trace>]
+    if (argc == 4)
+    {
+        // prints the outcome itself
+        traceDiff(argv[2], argv[3], stdout);
+        return 0;
+    }
+    if (argc != 3)
+        return -1;
+    chip8_trace_reader* reader = traceReaderOpen(argv[2]);
+    if (reader == NULL)
     {
-        fread(&ram_out[i], sizeof(unsigned char), 1, romPtr);
+        printf("cannot read %s\n", argv[2]);
+        return 0;
     }
+    trace_record rec;
+    int got;
+    while ((got = traceRead(reader, &rec)) > 0)
+        tracePrintRecord(&rec, stdout);
+    if (got < 0)
+        printf("%s is truncated or corrupt\n", argv[2]);
+    traceReaderClose(reader);
+    return 0;
+}
 
-    fclose(romPtr);
+int convertFrames(int argc, char** argv)
+{
+    // -V <stream> <out> [<first> [<count>]]
+    if (argc > 6)
+        return -1;
+    long long first = argc > 4 ? atoll(argv[4]) : 0;
+    long long count = argc > 5 ? atoll(argv[5]) : -1;
+    if (first < 0)
+        return -1;
+    long long frames;
+    int status = streamConvert(argv[2], argv[3], first, count, &frames);
+    if (status == -1)
+        printf("cannot convert %s to %s\n", argv[2], argv[3]);
+    else
+        printf("%lld frames written to %s%s\n", frames, argv[3], status == -2 ? ", the stream is truncated or corrupt after them" : "");
+    return 0;
+}
 
-    return rom_size;
+void disassemble(char* rom_in, int dot)
+{
+    static chip8_state state;
+    static chip8_cfg cfg;
+    chip8Init(&state, NULL);
+    long int rom_size = chip8LoadRom(&state, rom_in);
+    if (rom_size < 0)
+    {
+        printf("cannot read %s\n", rom_in);
+        return;
+    }
+
+    cfgAnalyze(state.ram, rom_size, &cfg);
+    if (dot)
+        cfgWriteDot(&cfg, state.ram, stdout);
+    else
+        cfgWriteText(&cfg, state.ram, stdout);
 }
 
-void initializeFont(unsigned char* ram_out)
+void execute(char* rom_in, const run_options* opts)
 {
-    unsigned char font[16][5] = {
-        {0xF0, 0x90, 0x90, 0x90, 0xF0}, // 0
-        {0x20, 0x60, 0x20, 0x20, 0x70}, // 1
-        {0xF0, 0x10, 0xF0, 0x80, 0xF0}, // 2
-        {0xF0, 0x10, 0xF0, 0x10, 0xF0}, // 3
-        {0x90, 0x90, 0xF0, 0x10, 0x10}, // 4
-        {0xF0, 0x80, 0xF0, 0x10, 0xF0}, // 5
-        {0xF0, 0x80, 0xF0, 0x90, 0xF0}, // 6
-        {0xF0, 0x10, 0x20, 0x40, 0x40}, // 7
-        {0xF0, 0x90, 0xF0, 0x90, 0xF0}, // 8
-        {0xF0, 0x90, 0xF0, 0x10, 0xF0}, // 9
-        {0xF0, 0x90, 0xF0, 0x90, 0x90}, // A
-        {0xE0, 0x90, 0xE0, 0x90, 0xE0}, // B
-        {0xF0, 0x80, 0x80, 0x80, 0xF0}, // C
-        {0xE0, 0x90, 0x90, 0x90, 0xE0}, // D
-        {0xF0, 0x80, 0xF0, 0x80, 0xF0}, // E
-        {0xF0, 0x80, 0xF0, 0x80, 0x80}  // F
-    };
-    // font from 0x50 to 0x9F
-    unsigned short ram_index = 0x50;
-    for (int i = 0; i < 16; i++)
-    {
-        for (int j = 0; j < 5; j++)
+    static chip8_state state;
+    struct timespec startTime;
+    frame_sched sched;
+    chip8_rewind* rw = NULL;
+    chip8_recorder* rec = NULL;
+    chip8_replay* replay = NULL;
+    replay_result replayed;
+    int tickInsts = opts->tickInsts;
+    uint32_t seed = opts->seed;
+    long long startCycles = 0; // a resumed snapshot has already run some
+    int ran = 0; // set once every output is open and the machine has run
+    chip8_jit* jit = opts->useJit ? chip8JitCreate() : NULL;
+
+    if (opts->replayPath)
+    {
+        // the recording fixes the seed, frame length and quirks profile
+        replay = replayOpen(opts->replayPath);
+        if (replay == NULL)
+        {
+            printf("invalid input log: %s\n", opts->replayPath);
+            goto done;
+        }
+        seed = replaySeed(replay);
+        tickInsts = replayTickInsts(replay);
+    }
+
+    chip8Init(&state, opts->headless ? &chip8NullFrontend : &chip8NcursesFrontend);
+    chip8Seed(&state, seed ? seed : clockSeed());
+    int opened = saveOpen(&state, rom_in);
+    if (opened < 0)
+        goto done;
+    // a snapshot carries its own generator state unless a seed was given
+    if (opened == 1 && seed)
+        chip8Seed(&state, seed);
+    // likewise its quirks profile, and a recording its own unless -q overrides it
+    if (opts->quirks >= 0)
+        chip8SetQuirks(&state, opts->quirks);
+    else if (replay)
+        chip8SetQuirks(&state, replayQuirks(replay));
+    seed = state.rng;
+    startCycles = state.cycles;
+
+    if (opts->profilePrefix)
+    {
+#ifdef CHIP8_PROFILE
+        state.profile = profileCreate();
+#else
+        printf("built without CHIP8_PROFILE, -P ignored\n");
+#endif
+    }
+
+    if (opts->recordPath && (rec = recordOpen(opts->recordPath, seed, tickInsts, state.quirks)) == NULL)
+    {
+        printf("cannot write %s\n", opts->recordPath);
+        goto done;
+    }
+
+    // sound runs on its own thread: a capture file if asked for, else the bell when interactive
+    if (opts->audioPath || !opts->headless)
+    {
+        audio_sink* sink = opts->audioPath ? audioFileSink(opts->audioPath, opts->sampleRate) : audioBellSink(STDOUT_FILENO);
+        if (sink == NULL && opts->audioPath)
+        {
+            printf("cannot write %s\n", opts->audioPath);
+            goto done;
+        }
+        if (sink)
+            state.audio = audioCreate(sink, opts->sampleRate, AUDIO_TONE_HZ);
+    }
+
+    if (opts->tracePath && (state.trace = traceOpen(opts->tracePath, &state)) == NULL)
+    {
+        printf("cannot write %s\n", opts->tracePath);
+        goto done;
+    }
+
+    if (opts->streamPath && (state.stream = streamCreate(opts->streamPath)) == NULL)
+    {
+        printf("cannot write %s\n", opts->streamPath);
+        goto done;
+    }
+
+    state.frontend->open(state.frontend);
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+
+    if (replay)
+        replayRun(replay, &state, jit, &replayed);
+    else if (opts->headless)
+    {
+        // run in chunks at full speed, checking the wall clock in between
+        int status = CHIP8_OK;
+        while (status == CHIP8_OK)
+        {
+            long long slice = (long long) tickInsts * 4096;
+            if (opts->cycleBudget > 0 && opts->cycleBudget - (state.cycles - startCycles) < slice)
+                slice = opts->cycleBudget - (state.cycles - startCycles);
+            if (slice <= 0)
+                break;
+            if (opts->timeBudget > 0 && elapsedSeconds(&startTime) >= opts->timeBudget)
+                break;
+
+            if (jit)
+                status = chip8JitRunTicked(jit, &state, slice, tickInsts);
+            else
+                status = chip8RunTicked(&state, slice, tickInsts);
+        }
+    }
+    else
+    {
+        // tickInsts instructions and one timer tick per 60Hz frame, paced on absolute deadlines
+        int status = CHIP8_OK;
+        int frames = 1;
+        schedInit(&sched, 60, MAX_CATCHUP);
+        // rewinding would break the recorded frame timeline
+        if (opts->rewindKB > 0 && !rec)
+            rw = rewindCreate((size_t) opts->rewindKB * 1024, REWIND_KEY_FRAMES);
+        if (rw)
+            rewindPush(rw, &state);
+        while (status == CHIP8_OK)
+        {
+            // one input drain per wakeup, the core reads the bitmap without syscalls
+            uint32_t input = state.frontend->pollKeys(state.frontend);
+            state.keys = input & 0xFFFF;
+            if (rw && (input & CHIP8_HOST_REWIND))
+            {
+                // step back one frame per wakeup while rewind is held
+                rewindPop(rw, &state);
+                frames = 0;
+            }
+            for (int i = 0; i < frames && status == CHIP8_OK; i++)
+            {
+                status = chip8Run(&state, tickInsts);
+                if (status == CHIP8_OK)
+                    chip8TickTimers(&state);
+                if (rw)
+                    rewindPush(rw, &state);
+                if (rec)
+                    recordFrame(rec, state.keys, &state);
+            }
+            // present once however many frames ran
+            if (state.drawFlag)
+            {
+                state.frontend->draw(state.frontend, &state);
+                state.drawFlag = 0;
+            }
+            frames = schedWait(&sched);
+        }
+    }
+    state.frontend->close(state.frontend);
+    ran = 1;
+    if (opts->saveOut && saveWrite(&state, opts->saveOut) < 0)
+        printf("cannot write %s\n", opts->saveOut);
+
+    // a setup failure jumps here to stop and finish whatever it had already started
+done:
+    if (rec && recordClose(rec, &state) < 0)
+        printf("cannot write %s\n", opts->recordPath);
+    if (state.trace)
+    {
+        trace_stats traced;
+        if (traceClose(state.trace, &traced) < 0)
+            printf("cannot write %s\n", opts->tracePath);
+        state.trace = NULL;
+        if (ran)
+            printf("trace: %lld instructions, %lld bytes encoded, %lld written (%.2f per instruction)\n", traced.records,
+                traced.rawBytes, traced.fileBytes, traced.records ? (double) traced.fileBytes / traced.records : 0.0);
+    }
+    if (state.stream)
+    {
+        stream_stats streamed;
+        if (streamClose(state.stream, &streamed) < 0)
+            printf("cannot write %s\n", opts->streamPath);
+        state.stream = NULL;
+        if (ran)
+            printf("frames: %lld streamed, %lld changed, %lld bytes written (%.2f per frame)\n", streamed.frames, streamed.changed,
+                streamed.bytes, streamed.frames ? (double) streamed.bytes / streamed.frames : 0.0);
+    }
+    if (state.audio)
+    {
+        audio_stats sound;
+        if (audioClose(state.audio, &sound) < 0)
+            printf("cannot write %s\n", opts->audioPath);
+        state.audio = NULL;
+        if (ran && opts->audioPath)
+            printf("audio: %lld frames, %lld with tone, %lld samples, %lld frames dropped\n", sound.frames, sound.toneFrames,
+                sound.samples, sound.dropped);
+    }
+    if (state.profile)
+    {
+        if (ran)
+            writeProfile(state.profile, opts->profilePrefix);
+        profileDestroy(state.profile);
+        state.profile = NULL;
+    }
+    if (ran && !opts->headless)
+    {
+        schedPrint(&sched, stdout);
+        if (rw)
+        {
+            chip8_rewind_stats stats;
+            rewindStats(rw, &stats);
+            printf("rewind: %d frames held in %zu bytes (%.0f per frame), %lld captured, %lld evicted\n", stats.frames, stats.bytes,
+                stats.frames ? (double) stats.bytes / stats.frames : 0.0, stats.pushed, stats.evicted);
+        }
+    }
+
+    // report throughput and final machine state
+    if (ran && opts->headless)
+    {
+        double seconds = elapsedSeconds(&startTime);
+        long long executed = state.cycles - startCycles;
+        printf("instructions: %lld\n", executed);
+        printf("seconds: %.6f\n", seconds);
+        printf("instructions/sec: %.0f (%.3f MIPS)\n", seconds > 0 ? executed / seconds : 0.0, seconds > 0 ? executed / seconds / 1e6 : 0.0);
+        printf("idle instructions skipped: %lld\n", state.idleCycles);
+        printf("seed: %u\n", seed);
+        if (state.fault)
+            printf("fault: %s at %03x\n", chip8FaultName(state.fault), state.pc);
+        if (replay)
         {
-            ram_out[ram_index++] = font[i][j];
+            printf("replay: %lld frames, %d checkpoints, %d mismatches", replayed.frames, replayed.checkpoints, replayed.mismatches);
+            if (replayed.mismatches)
+                printf(" (first at frame %lld)", replayed.firstMismatch);
+            printf("\n");
         }
-    }    
+        if (jit)
+        {
+            const chip8_jit_stats* stats = chip8JitStats(jit);
+            printf("blocks: %lld translated, %lld invalidated, %lld fused instructions\n", stats->translations, stats->invalidations, stats->fused);
+            printf("block cache: %lld lookups, %.2f%% hits, %lld cut short by the budget, %lld interpreter fallbacks\n", stats->lookups,
+                stats->lookups ? 100.0 * stats->hits / stats->lookups : 0.0, stats->partial, stats->fallbacks);
+        }
+        chip8DumpState(&state, stdout);
+    }
+    rewindDestroy(rw);
+    replayClose(replay);
+    chip8JitDestroy(jit);
 }
 
-unsigned char convertKey(int keyIn)
+void writeProfile(const chip8_profile* profile, const char* prefix)
 {
-    unsigned char keyOut; 
-    switch (keyIn)
+    char path[4096];
+    snprintf(path, sizeof(path), "%s.json", prefix);
+    FILE* out = fopen(path, "w");
+    if (out)
     {
-        case '1':
-            keyOut = 1;
-            break;
-        case '2':
-            keyOut = 2;
-            break;
-        case '3':
-            keyOut = 3;
-            break;
-        case '4':
-            keyOut = 0xc;
-            break;
-        case 'q':
-            keyOut = 4;
-            break;
-        case 'w':
-            keyOut = 5;
-            break;
-        case 'e':
-            keyOut = 6;
-            break;
-        case 'r':
-            keyOut = 0xd;
-            break;
-        case 'a':
-            keyOut = 7;
-            break;
-        case 's':
-            keyOut = 8;
-            break;
-        case 'd':
-            keyOut = 9;
-            break;
-        case 'f':
-            keyOut = 0xe;
-            break;
-        case 'z':
-            keyOut = 0xa;
-            break;
-        case 'x':
-            keyOut = 0;
-            break;
-        case 'c':
-            keyOut = 0xb;
-            break;
-        case 'v':
-            keyOut = 0xf;
-            break;
-        default:
-            keyOut = 0xff;
-            break;
+        profileWriteJson(profile, out);
+        fclose(out);
+    }
+    else
+        printf("cannot write %s\n", path);
+    snprintf(path, sizeof(path), "%s.folded", prefix);
+    out = fopen(path, "w");
+    if (out)
+    {
+        profileWriteFolded(profile, out);
+        fclose(out);
     }
-    return keyOut;
+    else
+        printf("cannot write %s\n", path);
+}
+
+double elapsedSeconds(struct timespec* start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+uint32_t clockSeed(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint32_t) now.tv_sec ^ (uint32_t) now.tv_nsec;
 }
@@ -0,0 +1,93 @@
+#include "chip8.h"
+
+void chip8Decode(unsigned short inst, chip8_decoded* out)
+{
+    unsigned short opcode = (inst&0xF000)>>12;
+    unsigned short valN = (inst&0x000F);
+    unsigned short valNN = (inst&0x00FF);
+    unsigned char op = CHIP8_OP_INVALID;
+
+    out->x = (inst&0x0F00)>>8;
+    out->y = (inst&0x00F0)>>4;
+    out->n = valN;
+    out->nnn = (inst&0x0FFF);
+
+    switch (opcode)
+    {
+        case 0x0:
+            switch (valNN)
+            {
+                case 0xE0: op = CHIP8_OP_CLS; break;
+                case 0xEE: op = CHIP8_OP_RET; break;
+                case 0xFB: op = CHIP8_OP_SCR; break;
+                case 0xFC: op = CHIP8_OP_SCL; break;
+                case 0xFD: op = CHIP8_OP_EXIT; break;
+                case 0xFE: op = CHIP8_OP_LOW; break;
+                case 0xFF: op = CHIP8_OP_HIGH; break;
+                default:
+                    if ((inst & 0xFFF0) == 0x00C0)
+                        op = CHIP8_OP_SCD;
+                    else if ((inst & 0xFFF0) == 0x00D0)
+                        op = CHIP8_OP_SCU;
+                    else
+                        op = CHIP8_OP_SYS;
+                    break;
+            }
+            break;
+        case 0x1: op = CHIP8_OP_JP; break;
+        case 0x2: op = CHIP8_OP_CALL; break;
+        case 0x3: op = CHIP8_OP_SE_VX_NN; break;
+        case 0x4: op = CHIP8_OP_SNE_VX_NN; break;
+        case 0x5: op = CHIP8_OP_SE_VX_VY; break;
+        case 0x6: op = CHIP8_OP_LD_VX_NN; break;
+        case 0x7: op = CHIP8_OP_ADD_VX_NN; break;
+        case 0x8:
+            switch (valN)
+            {
+                case 0x0: op = CHIP8_OP_LD_VX_VY; break;
+                case 0x1: op = CHIP8_OP_OR; break;
+                case 0x2: op = CHIP8_OP_AND; break;
+                case 0x3: op = CHIP8_OP_XOR; break;
+                case 0x4: op = CHIP8_OP_ADD_VX_VY; break;
+                case 0x5: op = CHIP8_OP_SUB; break;
+                case 0x6: op = CHIP8_OP_SHR; break;
+                case 0x7: op = CHIP8_OP_SUBN; break;
+                case 0xE: op = CHIP8_OP_SHL; break;
+                default: break;
+            }
+            break;
+        case 0x9: op = CHIP8_OP_SNE_VX_VY; break;
+        case 0xA: op = CHIP8_OP_LD_I; break;
+        case 0xB: op = CHIP8_OP_JP_V0; break;
+        case 0xC: op = CHIP8_OP_RND; break;
+        case 0xD: op = CHIP8_OP_DRW; break;
+        case 0xE:
+            switch (valNN)
+            {
+                case 0x9E: op = CHIP8_OP_SKP; break;
+                case 0xA1: op = CHIP8_OP_SKNP; break;
+                default: break;
+            }
+            break;
+        case 0xF:
+            switch (valNN)
+            {
+                case 0x07: op = CHIP8_OP_LD_VX_DT; break;
+                case 0x0A: op = CHIP8_OP_LD_VX_K; break;
+                case 0x15: op = CHIP8_OP_LD_DT_VX; break;
+                case 0x18: op = CHIP8_OP_LD_ST_VX; break;
+                case 0x1E: op = CHIP8_OP_ADD_I_VX; break;
+                case 0x29: op = CHIP8_OP_LD_F_VX; break;
+                case 0x33: op = CHIP8_OP_LD_B_VX; break;
+                case 0x55: op = CHIP8_OP_LD_MEM_VX; break;
+                case 0x65: op = CHIP8_OP_LD_VX_MEM; break;
+                case 0x30: op = CHIP8_OP_LD_HF_VX; break;
+                case 0x75: op = CHIP8_OP_LD_R_VX; break;
+                case 0x85: op = CHIP8_OP_LD_VX_R; break;
+                case 0x01: op = CHIP8_OP_PLANE; break;
+                default: break;
+            }
+            break;
+    }
+    out->op = op;
+}
@@ -0,0 +1,94 @@
+#include <stdio.h>
+
+#include "chip8.h"
+
+void chip8Disassemble(unsigned short inst, char* out, int outLen)
+{
+    unsigned short opcode = (inst&0xF000)>>12;
+    unsigned short regX = (inst&0x0F00)>>8;
+    unsigned short regY = (inst&0x00F0)>>4;
+    unsigned short valN = (inst&0x000F);
+    unsigned short valNN = (inst&0x00FF);
+    unsigned short valNNN = (inst&0x0FFF);
+
+    switch (opcode)
+    {
+        case 0x0:
+            switch (valNN)
+            {
+                case 0xE0: snprintf(out, outLen, "CLS"); break;
+                case 0xEE: snprintf(out, outLen, "RET"); break;
+                case 0xFB: snprintf(out, outLen, "SCR"); break;
+                case 0xFC: snprintf(out, outLen, "SCL"); break;
+                case 0xFD: snprintf(out, outLen, "EXIT"); break;
+                case 0xFE: snprintf(out, outLen, "LOW"); break;
+                case 0xFF: snprintf(out, outLen, "HIGH"); break;
+                default:
+                    if ((inst & 0xFFF0) == 0x00C0)
+                        snprintf(out, outLen, "SCD %x", valN);
+                    else if ((inst & 0xFFF0) == 0x00D0)
+                        snprintf(out, outLen, "SCU %x", valN);
+                    else
+                        snprintf(out, outLen, "SYS %03x", valNNN);
+                    break;
+            }
+            break;
+        case 0x1: snprintf(out, outLen, "JP %03x", valNNN); break;
+        case 0x2: snprintf(out, outLen, "CALL %03x", valNNN); break;
+        case 0x3: snprintf(out, outLen, "SE V%x, %02x", regX, valNN); break;
+        case 0x4: snprintf(out, outLen, "SNE V%x, %02x", regX, valNN); break;
+        case 0x5: snprintf(out, outLen, "SE V%x, V%x", regX, regY); break;
+        case 0x6: snprintf(out, outLen, "LD V%x, %02x", regX, valNN); break;
+        case 0x7: snprintf(out, outLen, "ADD V%x, %02x", regX, valNN); break;
+        case 0x8:
+            switch (valN)
+            {
+                case 0x0: snprintf(out, outLen, "LD V%x, V%x", regX, regY); break;
+                case 0x1: snprintf(out, outLen, "OR V%x, V%x", regX, regY); break;
+                case 0x2: snprintf(out, outLen, "AND V%x, V%x", regX, regY); break;
+                case 0x3: snprintf(out, outLen, "XOR V%x, V%x", regX, regY); break;
+                case 0x4: snprintf(out, outLen, "ADD V%x, V%x", regX, regY); break;
+                case 0x5: snprintf(out, outLen, "SUB V%x, V%x", regX, regY); break;
+                case 0x6: snprintf(out, outLen, "SHR V%x {, V%x}", regX, regY); break;
+                case 0x7: snprintf(out, outLen, "SUBN V%x, V%x", regX, regY); break;
+                case 0xE: snprintf(out, outLen, "SHL V%x {, V%x}", regX, regY); break;
+                default: snprintf(out, outLen, "not supported"); break;
+            }
+            break;
+        case 0x9: snprintf(out, outLen, "SNE V%x, V%x", regX, regY); break;
+        case 0xA: snprintf(out, outLen, "LD I, %03x", valNNN); break;
+        case 0xB: snprintf(out, outLen, "JP V0, %03x", valNNN); break;
+        case 0xC: snprintf(out, outLen, "RND V%x, %02x", regX, valNN); break;
+        case 0xD: snprintf(out, outLen, "DRW V%x, V%x, %x", regX, regY, valN); break;
+        case 0xE:
+            switch (valNN)
+            {
+                case 0x9E: snprintf(out, outLen, "SKP V%x", regX); break;
+                case 0xA1: snprintf(out, outLen, "SKNP V%x", regX); break;
+                default: snprintf(out, outLen, "not supported"); break;
+            }
+            break;
+        case 0xF:
+            switch (valNN)
+            {
+                case 0x07: snprintf(out, outLen, "LD V%x, DT", regX); break;
+                case 0x0A: snprintf(out, outLen, "LD V%x, K", regX); break;
+                case 0x15: snprintf(out, outLen, "LD DT, V%x", regX); break;
+                case 0x18: snprintf(out, outLen, "LD ST, V%x", regX); break;
+                case 0x1E: snprintf(out, outLen, "ADD I, V%x", regX); break;
+                case 0x29: snprintf(out, outLen, "LD F, V%x", regX); break;
+                case 0x33: snprintf(out, outLen, "LD B, V%x", regX); break;
+                case 0x55: snprintf(out, outLen, "LD [I], V%x", regX); break;
+                case 0x65: snprintf(out, outLen, "LD V%x, [I]", regX); break;
+                case 0x30: snprintf(out, outLen, "LD HF, V%x", regX); break;
+                case 0x75: snprintf(out, outLen, "LD R, V%x", regX); break;
+                case 0x85: snprintf(out, outLen, "LD V%x, R", regX); break;
+                case 0x01: snprintf(out, outLen, "PLANE %x", regX); break;
+                default: snprintf(out, outLen, "not supported"); break;
+            }
+            break;
+        default:
+            snprintf(out, outLen, "not supported");
+            break;
+    }
+}
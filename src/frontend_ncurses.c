@@ -0,0 +1,183 @@
+#define _POSIX_C_SOURCE 200809L
+#include <ncurses.h>
+#include <string.h>
+#include <time.h>
+
+#include "chip8.h"
+
+static unsigned char convertKey(int keyIn);
+
+// what is currently on the terminal, so each present only writes cells that changed
+typedef struct ncurses_screen
+{
+    uint64_t shown[DISPLAY_PLANES][DISPLAY_WORDS][DISPLAY_HIRES_H];
+    unsigned char hires; // mode of shown
+    chip8_render_stats stats;
+    long long keySeen[17]; // monotonic ns of the last character for each key and rewind, 0 if never
+} ncurses_screen;
+
+static ncurses_screen screen;
+// terminals only report presses, a key counts as held this long after its last character
+static int keyReleaseMs = 150;
+
+static void ncursesOpen(chip8_frontend* fe)
+{
+    initscr();
+    curs_set(0);
+    noecho();
+    keypad(stdscr, TRUE);
+    memset(&screen, 0, sizeof(screen));
+}
+
+static void ncursesClose(chip8_frontend* fe)
+{
+    endwin();
+    if (screen.stats.frames > 0)
+    {
+        printf("frames presented: %lld, cells written: %lld (%.1f per frame, %d in last frame)\n",
+            screen.stats.frames, screen.stats.cells, (double) screen.stats.cells / screen.stats.frames, screen.stats.lastFrameCells);
+    }
+}
+
+static void ncursesDraw(chip8_frontend* fe, const chip8_state* state)
+{
+    // blank, plane 0, plane 1, both
+    const chtype shades[4] = { ' ', ACS_CKBOARD, '+', ACS_BLOCK };
+    int cells = 0;
+    if (state->hires != screen.hires)
+    {
+        // the mode switch cleared the display, the terminal follows
+        clear();
+        memset(screen.shown, 0, sizeof(screen.shown));
+        screen.hires = state->hires;
+    }
+    int words = state->hires ? DISPLAY_WORDS : 1;
+    for (short row=0; row < chip8DisplayHeight(state); row++)
+    {
+        for (int w = 0; w < words; w++)
+        {
+            uint64_t changed = 0;
+            for (int plane = 0; plane < DISPLAY_PLANES; plane++)
+            {
+                changed |= state->display[plane][w][row] ^ screen.shown[plane][w][row];
+                screen.shown[plane][w][row] = state->display[plane][w][row];
+            }
+            for (short col = 0; changed; col++, changed <<= 1)
+            {
+                if (changed >> 63)
+                {
+                    mvaddch(row, 64 * w + col, shades[chip8Pixel(state, 64 * w + col, row)]);
+                    cells++;
+                }
+            }
+        }
+    }
+    if (cells)
+        refresh();
+
+    screen.stats.frames++;
+    screen.stats.cells += cells;
+    screen.stats.lastFrameCells = cells;
+}
+
+const chip8_render_stats* chip8NcursesStats(void)
+{
+    return &screen.stats;
+}
+
+void chip8NcursesSetKeyRelease(int ms)
+{
+    keyReleaseMs = ms;
+}
+
+static uint32_t ncursesPollKeys(chip8_frontend* fe)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    long long now = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+
+    // drain everything typed since the last poll so no press is lost
+    timeout(0);
+    for (int c = getch(); c != ERR; c = getch())
+    {
+        // map to hexadecimal keypad, backspace rewinds
+        unsigned char key = (c == KEY_BACKSPACE || c == 127 || c == '\b') ? 16 : convertKey(c);
+        if (key != CHIP8_NO_KEY)
+            screen.keySeen[key] = now;
+    }
+
+    uint32_t keys = 0;
+    for (int key = 0; key < 17; key++)
+    {
+        if (screen.keySeen[key] && now - screen.keySeen[key] < keyReleaseMs * 1000000LL)
+            keys |= 1u << key;
+    }
+    return keys;
+}
+
+static void ncursesBeep(chip8_frontend* fe)
+{
+    beep();
+}
+
+chip8_frontend chip8NcursesFrontend = { ncursesOpen, ncursesClose, ncursesDraw, ncursesPollKeys, ncursesBeep, NULL };
+
+static unsigned char convertKey(int keyIn)
+{
+    unsigned char keyOut; 
+    switch (keyIn)
+    {
+        case '1':
+            keyOut = 1;
+            break;
+        case '2':
+            keyOut = 2;
+            break;
+        case '3':
+            keyOut = 3;
+            break;
+        case '4':
+            keyOut = 0xc;
+            break;
+        case 'q':
+            keyOut = 4;
+            break;
+        case 'w':
+            keyOut = 5;
+            break;
+        case 'e':
+            keyOut = 6;
+            break;
+        case 'r':
+            keyOut = 0xd;
+            break;
+        case 'a':
+            keyOut = 7;
+            break;
+        case 's':
+            keyOut = 8;
+            break;
+        case 'd':
+            keyOut = 9;
+            break;
+        case 'f':
+            keyOut = 0xe;
+            break;
+        case 'z':
+            keyOut = 0xa;
+            break;
+        case 'x':
+            keyOut = 0;
+            break;
+        case 'c':
+            keyOut = 0xb;
+            break;
+        case 'v':
+            keyOut = 0xf;
+            break;
+        default:
+            keyOut = CHIP8_NO_KEY;
+            break;
+    }
+    return keyOut;
+}
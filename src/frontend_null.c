@@ -0,0 +1,26 @@
+#include "chip8.h"
+
+// front end for headless and embedded use: no display, no keyboard, no sound
+
+static void nullOpen(chip8_frontend* fe)
+{
+}
+
+static void nullClose(chip8_frontend* fe)
+{
+}
+
+static void nullDraw(chip8_frontend* fe, const chip8_state* state)
+{
+}
+
+static uint32_t nullPollKeys(chip8_frontend* fe)
+{
+    return 0;
+}
+
+static void nullBeep(chip8_frontend* fe)
+{
+}
+
+chip8_frontend chip8NullFrontend = { nullOpen, nullClose, nullDraw, nullPollKeys, nullBeep, NULL };
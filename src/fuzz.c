@@ -0,0 +1,530 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "chip8.h"
+#include "batch.h"
+#include "pool.h"
+#include "replay.h"
+
+// coverage guided fuzzer: mutates ROM bytes and per-frame key timelines, runs each case
+// headless for a bounded number of frames and keeps cases that reach a new (pc, handler)
+// pair. every case starts from one power-on snapshot restored by memcpy, so a case costs
+// its own instructions plus a few KB of copying. faults (see CHIP8_FAULT) are written
+// out as a ROM and an input log that chip8emu -p replays.
+
+#define FUZZ_CYCLES 1024 // instructions per case
+#define FUZZ_TICK_INSTS 8
+#define FUZZ_MAX_FRAMES 1024
+#define FUZZ_MAX_ROM (MEM_SIZE - START_ADDR)
+#define FUZZ_CORPUS 1024 // cases kept per worker
+#define FUZZ_MAX_FAULTS 256 // distinct faults reported
+#define FUZZ_STACK 8 // most mutations stacked on one case
+#define FUZZ_REPORT_EXECS 4096 // executions between checks of the budget and progress
+
+// (pc, handler) pairs reached, one bit each
+#define FEATURE_WORDS (MEM_SIZE * CHIP8_OP_COUNT / 64)
+
+typedef struct fuzz_case
+{
+    int size; // ROM bytes
+    int frames; // frames keys holds, the case runs all of them unless it stops
+    unsigned char rom[FUZZ_MAX_ROM];
+    uint16_t keys[FUZZ_MAX_FRAMES]; // held keys of each frame
+} fuzz_case;
+
+typedef struct fuzz_fault
+{
+    int kind;
+    unsigned short pc;
+} fuzz_fault;
+
+// settings and the state every worker shares
+typedef struct fuzz_ctx
+{
+    long long maxExecs; // 0 for no limit
+    double seconds; // 0 for no limit
+    int frames;
+    int tickInsts;
+    int quirks;
+    uint32_t seed;
+    const char* outDir;
+    fuzz_case* seeds;
+    int seedCount;
+    struct timespec start;
+
+    pthread_mutex_t lock; // faults and the output
+    fuzz_fault faults[FUZZ_MAX_FAULTS];
+    int faultCount;
+    long long faultExecs; // executions that faulted, including repeats
+
+    long long execs; // updated every FUZZ_REPORT_EXECS by each worker
+    int stop;
+    uint64_t features[FEATURE_WORDS]; // union over the workers, merged at the end
+    long long corpus;
+} fuzz_ctx;
+
+typedef struct fuzz_worker
+{
+    chip8_state base; // power on, the quirks profile and seed set, no ROM
+    chip8_state state;
+    uint32_t rng; // xorshift32 for the mutations
+    uint64_t features[FEATURE_WORDS];
+    int featureCount;
+    fuzz_case* corpus;
+    int count;
+    fuzz_case work;
+} fuzz_worker;
+
+static double elapsed(const struct timespec* start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static uint32_t next(fuzz_worker* w)
+{
+    uint32_t r = w->rng;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    return w->rng = r;
+}
+
+static int below(fuzz_worker* w, int n)
+{
+    return (int)(((uint64_t) next(w) * (uint32_t) n) >> 32);
+}
+
+// restore the snapshot: everything but the decoded table, which the coverage sweep
+// zeroed as it read it
+static void reset(chip8_state* state, const chip8_state* base)
+{
+    memcpy(state, base, offsetof(chip8_state, decoded));
+    memcpy(&state->codePages, &base->codePages, sizeof(chip8_state) - offsetof(chip8_state, codePages));
+}
+
+static int runCase(const fuzz_ctx* ctx, chip8_state* state, const fuzz_case* c)
+{
+    int status = CHIP8_OK;
+    memcpy(&state->ram[START_ADDR], c->rom, c->size);
+    state->romSize = c->size;
+    for (int f = 0; f < c->frames && status == CHIP8_OK; f++)
+    {
+        state->keys = c->keys[f];
+        status = chip8Run(state, ctx->tickInsts);
+        if (status == CHIP8_OK)
+            chip8TickTimers(state);
+    }
+    return status;
+}
+
+// count the (pc, handler) pairs the run decoded that are new to this worker and clear
+// the decoded table for the next case. an entry is only decoded when pc reaches it (the
+// wait loop check also decodes the two instructions after an FX07), and pc never runs
+// at or past the end of the ROM. most entries were never reached, so the table is read
+// four entries a time and cleared whole, which keeps untouched runs all zero
+static int sweep(fuzz_worker* w)
+{
+    chip8_decoded* decoded = w->state.decoded;
+    int end = START_ADDR + (int) w->state.romSize;
+    int found = 0;
+    for (int addr = 0; addr < end; addr += 4)
+    {
+        uint64_t words[sizeof(chip8_decoded) * 4 / sizeof(uint64_t)];
+        uint64_t any = 0;
+        memcpy(words, &decoded[addr], sizeof(words));
+        for (int i = 0; i < (int)(sizeof(words) / sizeof(uint64_t)); i++)
+            any |= words[i];
+        if (!any)
+            continue;
+        for (int i = addr; i < addr + 4; i++)
+        {
+            if (decoded[i].op == CHIP8_OP_DECODE)
+                continue;
+            unsigned int feature = i * CHIP8_OP_COUNT + decoded[i].op;
+            uint64_t bit = 1ULL << (feature & 63);
+            if (!(w->features[feature >> 6] & bit))
+            {
+                w->features[feature >> 6] |= bit;
+                found++;
+            }
+        }
+        memset(&decoded[addr], 0, 4 * sizeof(chip8_decoded));
+    }
+    w->featureCount += found;
+    return found;
+}
+
+// an instruction chosen to hit the edges: calls and returns, I near the end of ram,
+// memory and draw instructions, jumps and calls into the ROM, or any word at all
+static unsigned short edgeInstruction(fuzz_worker* w, int size)
+{
+    unsigned short target = START_ADDR + (below(w, size > 1 ? size / 2 : 1) << 1);
+    int x = below(w, 16);
+    switch (below(w, 10))
+    {
+        case 0: return 0x00EE;
+        case 1: return 0x2000 | target;
+        case 2: return 0x1000 | target;
+        case 3: return 0xA000 | (MEM_SIZE - 1 - below(w, 64));
+        case 4: return 0xF01E | (x << 8);
+        case 5: return 0xF055 | (x << 8);
+        case 6: return 0xF065 | (x << 8);
+        case 7: return 0xF033 | (x << 8);
+        case 8: return 0xD000 | (next(w) & 0x0FFF);
+        default: return next(w) & 0xFFFF;
+    }
+}
+
+static void mutateRom(fuzz_worker* w, fuzz_case* c)
+{
+    int size = c->size;
+    switch (below(w, 7))
+    {
+        case 0: // flip a bit
+            c->rom[below(w, size)] ^= 1 << below(w, 8);
+            break;
+        case 1: // any byte
+            c->rom[below(w, size)] = next(w);
+            break;
+        case 2: // an edge case instruction over an aligned one
+        {
+            int at = below(w, size) & ~1;
+            unsigned short inst = edgeInstruction(w, size);
+            c->rom[at] = inst >> 8;
+            if (at + 1 < size)
+                c->rom[at + 1] = inst & 0xFF;
+            break;
+        }
+        case 3: // copy a run of bytes within the ROM
+        {
+            int len = 1 + below(w, size < 32 ? size : 32);
+            int from = below(w, size - len + 1);
+            int to = below(w, size - len + 1);
+            memmove(&c->rom[to], &c->rom[from], len);
+            break;
+        }
+        case 4: // take the tail of another corpus entry
+        {
+            const fuzz_case* other = &w->corpus[below(w, w->count)];
+            int at = below(w, size) & ~1;
+            if (at < other->size)
+            {
+                memcpy(&c->rom[at], &other->rom[at], other->size - at);
+                c->size = other->size;
+            }
+            break;
+        }
+        case 5: // insert an instruction
+            if (size + 2 <= FUZZ_MAX_ROM)
+            {
+                int at = below(w, size + 1) & ~1;
+                unsigned short inst = edgeInstruction(w, size);
+                memmove(&c->rom[at + 2], &c->rom[at], size - at);
+                c->rom[at] = inst >> 8;
+                c->rom[at + 1] = inst & 0xFF;
+                c->size += 2;
+            }
+            break;
+        default: // drop an instruction
+            if (size > 2)
+            {
+                int at = below(w, size - 1) & ~1;
+                memmove(&c->rom[at], &c->rom[at + 2], size - at - 2);
+                c->size -= 2;
+            }
+            break;
+    }
+}
+
+static void mutateKeys(fuzz_worker* w, fuzz_case* c)
+{
+    int from = below(w, c->frames);
+    int to = from + 1 + below(w, c->frames - from);
+    // one key, none or any set, held over a run of frames as a player would
+    uint16_t keys = below(w, 4) ? 1 << below(w, 16) : below(w, 2) ? 0 : (uint16_t) next(w);
+    for (int f = from; f < to; f++)
+        c->keys[f] = keys;
+}
+
+// distinct faults are kept, returns 1 for one not seen before
+static int newFault(fuzz_ctx* ctx, int kind, unsigned short pc)
+{
+    int fresh = 1;
+    pthread_mutex_lock(&ctx->lock);
+    ctx->faultExecs++;
+    for (int i = 0; i < ctx->faultCount && fresh; i++)
+        fresh = !(ctx->faults[i].kind == kind && ctx->faults[i].pc == pc);
+    if (fresh && ctx->faultCount < FUZZ_MAX_FAULTS)
+    {
+        ctx->faults[ctx->faultCount].kind = kind;
+        ctx->faults[ctx->faultCount].pc = pc;
+        ctx->faultCount++;
+    }
+    else
+        fresh = 0;
+    pthread_mutex_unlock(&ctx->lock);
+    return fresh;
+}
+
+// rerun the case recording its keys, and write the ROM and log next to each other
+static void writeReproducer(fuzz_ctx* ctx, fuzz_worker* w, const fuzz_case* c, int kind)
+{
+    static const char* names[] = { "none", "overflow", "underflow", "memory" };
+    unsigned short pc = w->state.pc;
+    char rom[4096], log[4096];
+    snprintf(rom, sizeof(rom), "%s/fault-%s-%03x.ch8", ctx->outDir, names[kind], pc);
+    snprintf(log, sizeof(log), "%s/fault-%s-%03x.rpl", ctx->outDir, names[kind], pc);
+
+    FILE* out = fopen(rom, "wb");
+    chip8_recorder* rec = recordOpen(log, ctx->seed, ctx->tickInsts, ctx->quirks);
+    if (out == NULL || rec == NULL || fwrite(c->rom, 1, c->size, out) != (size_t) c->size)
+    {
+        pthread_mutex_lock(&ctx->lock);
+        printf("cannot write %s\n", out == NULL ? rom : log);
+        pthread_mutex_unlock(&ctx->lock);
+        if (out)
+            fclose(out);
+        if (rec)
+            recordClose(rec, &w->state);
+        return;
+    }
+    fclose(out);
+
+    chip8_state* state = &w->state;
+    int status = CHIP8_OK;
+    reset(state, &w->base);
+    memcpy(&state->ram[START_ADDR], c->rom, c->size);
+    state->romSize = c->size;
+    for (int f = 0; f < c->frames && status == CHIP8_OK; f++)
+    {
+        state->keys = c->keys[f];
+        status = chip8Run(state, ctx->tickInsts);
+        if (status == CHIP8_OK)
+            chip8TickTimers(state);
+        recordFrame(rec, state->keys, state);
+    }
+    recordClose(rec, state);
+    sweep(w);
+
+    pthread_mutex_lock(&ctx->lock);
+    printf("fault: %s at %03x after %lld instructions: chip8emu -p %s %s\n", chip8FaultName(kind), pc,
+        state->cycles, log, rom);
+    fflush(stdout);
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+static void addCase(fuzz_worker* w, const fuzz_case* c)
+{
+    // once full, a new case replaces a random one
+    int slot = w->count < FUZZ_CORPUS ? w->count++ : below(w, FUZZ_CORPUS);
+    fuzz_case* to = &w->corpus[slot];
+    to->size = c->size;
+    to->frames = c->frames;
+    memcpy(to->rom, c->rom, c->size);
+    memcpy(to->keys, c->keys, c->frames * sizeof(uint16_t));
+}
+
+// run c and keep it if it reached anything new, reporting any fault. returns 1 if kept
+static int execute(fuzz_ctx* ctx, fuzz_worker* w, const fuzz_case* c)
+{
+    reset(&w->state, &w->base);
+    int status = runCase(ctx, &w->state, c);
+    int kept = sweep(w) > 0;
+    if (kept)
+        addCase(w, c);
+    if (status == CHIP8_FAULT && newFault(ctx, w->state.fault, w->state.pc) && ctx->outDir)
+        writeReproducer(ctx, w, c, w->state.fault);
+    return kept;
+}
+
+static void fuzzWorker(void* arg, int index)
+{
+    fuzz_ctx* ctx = arg;
+    fuzz_worker* w = calloc(1, sizeof(fuzz_worker));
+    if (w)
+        w->corpus = malloc(FUZZ_CORPUS * sizeof(fuzz_case));
+    if (w == NULL || w->corpus == NULL)
+    {
+        if (w)
+            free(w);
+        return;
+    }
+    chip8Init(&w->base, NULL);
+    chip8SetQuirks(&w->base, ctx->quirks);
+    chip8Seed(&w->base, ctx->seed);
+    memcpy(&w->state, &w->base, sizeof(chip8_state));
+    w->rng = (ctx->seed ^ (0x9e3779b9u * (index + 1))) | 1;
+
+    // seed the corpus with every starting case, whatever it reaches
+    for (int i = 0; i < ctx->seedCount; i++)
+    {
+        if (!execute(ctx, w, &ctx->seeds[i]))
+            addCase(w, &ctx->seeds[i]);
+    }
+
+    long long execs = ctx->seedCount;
+    while (!__atomic_load_n(&ctx->stop, __ATOMIC_RELAXED))
+    {
+        for (int i = 0; i < FUZZ_REPORT_EXECS; i++)
+        {
+            const fuzz_case* from = &w->corpus[below(w, w->count)];
+            fuzz_case* c = &w->work;
+            c->size = from->size;
+            c->frames = from->frames;
+            memcpy(c->rom, from->rom, from->size);
+            memcpy(c->keys, from->keys, from->frames * sizeof(uint16_t));
+            for (int m = 1 + below(w, FUZZ_STACK); m > 0; m--)
+            {
+                if (below(w, 4))
+                    mutateRom(w, c);
+                else
+                    mutateKeys(w, c);
+            }
+            execute(ctx, w, c);
+        }
+        execs += FUZZ_REPORT_EXECS;
+
+        long long total = __atomic_add_fetch(&ctx->execs, FUZZ_REPORT_EXECS, __ATOMIC_RELAXED);
+        if ((ctx->maxExecs && total >= ctx->maxExecs) || (ctx->seconds > 0 && elapsed(&ctx->start) >= ctx->seconds))
+            __atomic_store_n(&ctx->stop, 1, __ATOMIC_RELAXED);
+        if (index == 0 && (execs / FUZZ_REPORT_EXECS) % 64 == 0)
+        {
+            double seconds = elapsed(&ctx->start);
+            fprintf(stderr, "%lld execs, %.0f/sec, %d features, %d cases, %d faults\n", total,
+                seconds > 0 ? total / seconds : 0.0, w->featureCount, w->count, __atomic_load_n(&ctx->faultCount, __ATOMIC_RELAXED));
+        }
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    for (int i = 0; i < FEATURE_WORDS; i++)
+        ctx->features[i] |= w->features[i];
+    ctx->corpus += w->count;
+    pthread_mutex_unlock(&ctx->lock);
+    free(w->corpus);
+    free(w);
+}
+
+// a case per readable ROM, or one of random bytes if none was given
+static int loadSeeds(fuzz_ctx* ctx, char** roms, int count)
+{
+    static chip8_state scratch;
+    ctx->seeds = calloc(count ? count : 1, sizeof(fuzz_case));
+    if (ctx->seeds == NULL)
+        return -1;
+    for (int i = 0; i < count; i++)
+    {
+        fuzz_case* c = &ctx->seeds[ctx->seedCount];
+        chip8Init(&scratch, NULL);
+        long int size = chip8LoadRom(&scratch, roms[i]);
+        if (size <= 0)
+            continue;
+        c->size = size;
+        c->frames = ctx->frames;
+        memcpy(c->rom, &scratch.ram[START_ADDR], size);
+        ctx->seedCount++;
+    }
+    if (ctx->seedCount == 0)
+    {
+        uint32_t r = ctx->seed | 1;
+        fuzz_case* c = &ctx->seeds[ctx->seedCount++];
+        c->size = 64;
+        c->frames = ctx->frames;
+        for (int i = 0; i < c->size; i++)
+        {
+            r ^= r << 13;
+            r ^= r >> 17;
+            r ^= r << 5;
+            c->rom[i] = r >> 24;
+        }
+    }
+    return 0;
+}
+
+static int popcount64(uint64_t v)
+{
+    int n = 0;
+    for (; v; v &= v - 1)
+        n++;
+    return n;
+}
+
+int main(int argc, char** argv)
+{
+    static fuzz_ctx ctx;
+    long long cycles = FUZZ_CYCLES;
+    int threads = 1;
+    char** roms = NULL;
+    int count = 0;
+    const char* quirksName = "modern";
+    ctx.tickInsts = FUZZ_TICK_INSTS;
+    ctx.seed = CHIP8_DEFAULT_SEED;
+    for (int argi = 1; argi < argc; argi++)
+    {
+        if (!strcmp(argv[argi], "-n") && argi+1 < argc)
+            ctx.maxExecs = atoll(argv[++argi]);
+        else if (!strcmp(argv[argi], "-t") && argi+1 < argc)
+            ctx.seconds = atof(argv[++argi]);
+        else if (!strcmp(argv[argi], "-c") && argi+1 < argc)
+            cycles = atoll(argv[++argi]);
+        else if (!strcmp(argv[argi], "-k") && argi+1 < argc)
+            ctx.tickInsts = atoi(argv[++argi]);
+        else if (!strcmp(argv[argi], "-j") && argi+1 < argc)
+            threads = atoi(argv[++argi]);
+        else if (!strcmp(argv[argi], "-q") && argi+1 < argc)
+            quirksName = argv[++argi];
+        else if (!strcmp(argv[argi], "-s") && argi+1 < argc)
+            ctx.seed = (uint32_t) strtoul(argv[++argi], NULL, 0);
+        else if (!strcmp(argv[argi], "-o") && argi+1 < argc)
+            ctx.outDir = argv[++argi];
+        else if (argv[argi][0] != '-' && batchCollect(argv[argi], &roms, &count) >= 0)
+            continue;
+        else
+        {
+            printf("Usage: %s [-n <execs>] [-t <seconds>] [-c <cycles>] [-k <insts>] [-j <threads>] [-q <quirks>]\n", argv[0]);
+            printf("       [-s <seed>] [-o <dir>] [<rom|dir|@list>...]\n");
+            printf("       mutates the given ROMs (or random bytes) and their key input, running each case for\n");
+            printf("       <cycles> instructions (default %d) in frames of <insts> (default %d) from a snapshot.\n", FUZZ_CYCLES, FUZZ_TICK_INSTS);
+            printf("       cases reaching a new pc and instruction are kept. stops after <execs> cases or <seconds>,\n");
+            printf("       and writes a ROM and an input log that chip8emu -p replays for each distinct fault to <dir>.\n");
+            return 1;
+        }
+    }
+    ctx.quirks = chip8QuirksByName(quirksName);
+    ctx.frames = ctx.tickInsts > 0 ? (int)((cycles + ctx.tickInsts - 1) / ctx.tickInsts) : 0;
+    if (cycles <= 0 || ctx.tickInsts <= 0 || ctx.frames > FUZZ_MAX_FRAMES || threads <= 0 || ctx.quirks < 0)
+        return 1;
+    if (ctx.maxExecs <= 0 && ctx.seconds <= 0)
+        ctx.seconds = 10;
+    if (loadSeeds(&ctx, roms, count) < 0)
+        return 1;
+
+    pthread_mutex_init(&ctx.lock, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &ctx.start);
+    // one worker per thread, each with its own corpus and coverage
+    poolRun(threads, threads, fuzzWorker, &ctx);
+    double seconds = elapsed(&ctx.start);
+
+    int features = 0;
+    for (int i = 0; i < FEATURE_WORDS; i++)
+        features += popcount64(ctx.features[i]);
+    printf("execs: %lld in %.3fs, %.0f/sec, %.0f/sec per thread\n", ctx.execs, seconds,
+        seconds > 0 ? ctx.execs / seconds : 0.0, seconds > 0 ? ctx.execs / seconds / threads : 0.0);
+    printf("coverage: %d pc/instruction pairs, %lld cases kept\n", features, ctx.corpus);
+    printf("faults: %d distinct, %lld executions faulted\n", ctx.faultCount, ctx.faultExecs);
+    for (int i = 0; i < ctx.faultCount; i++)
+        printf("  %s at %03x\n", chip8FaultName(ctx.faults[i].kind), ctx.faults[i].pc);
+
+    pthread_mutex_destroy(&ctx.lock);
+    for (int i = 0; i < count; i++)
+        free(roms[i]);
+    free(roms);
+    free(ctx.seeds);
+    return 0;
+}
@@ -0,0 +1,225 @@
+// interpreter loop, included by chip8.c once per quirk profile with INTERP_NAME set to
+// the function to define and INTERP_QUIRKS to the profile's constant CHIP8_QUIRK_* mask.
+// with INTERP_TRACE defined it is the traced copy instead: every instruction goes through
+// the trace hooks and the wait loop fast-forward is off so none are skipped.
+// DISPATCH, CASE, NEXT and FAULT come from chip8.c
+
+static int INTERP_NAME(chip8_state* state, long long cycles)
+{
+#ifdef __GNUC__
+    static const void* const handlers[CHIP8_OP_COUNT] = { CHIP8_OPS(CHIP8_OP_LABEL) };
+#endif
+    unsigned char* regXY = state->regXY;
+    unsigned char* ram = state->ram;
+    chip8_decoded* decoded = state->decoded;
+    unsigned int romEnd = state->romSize + START_ADDR;
+    unsigned short pc = state->pc;
+    long long left = cycles;
+    int status = CHIP8_OK;
+    chip8_decoded* d;
+
+next:
+    if (left == 0)
+        goto done;
+    // stop once execution runs off the end of the ROM
+    if (pc >= romEnd)
+    {
+        status = CHIP8_HALT;
+        goto done;
+    }
+    left--;
+    d = &decoded[pc];
+    PROFILE_STEP(state, pc);
+#ifdef INTERP_TRACE
+    traceStep(state->trace, state, pc);
+#endif
+dispatch:
+    PROFILE_OP(state, d->op);
+    DISPATCH(d->op)
+    {
+        CASE(DECODE)
+            chip8Decode((((unsigned short)ram[pc]) << 8) | ((unsigned short)ram[(pc+1) & (MEM_SIZE-1)]), d);
+            goto dispatch;
+        CASE(CLS)
+            opClear(state);
+            NEXT(pc + 2);
+        CASE(RET)
+            if (state->stackPointer == 0)
+                FAULT(CHIP8_FAULT_STACK_UNDERFLOW);
+            PROFILE_RETURN(state);
+            NEXT(state->stack[--state->stackPointer]);
+        CASE(SYS)
+            // not implementing
+            NEXT(pc + 2);
+        CASE(SCD)
+            opScrollRows(state, d->n);
+            NEXT(pc + 2);
+        CASE(SCU)
+            opScrollRows(state, -d->n);
+            NEXT(pc + 2);
+        CASE(SCR)
+            opScrollColumns(state, 1);
+            NEXT(pc + 2);
+        CASE(SCL)
+            opScrollColumns(state, 0);
+            NEXT(pc + 2);
+        CASE(EXIT)
+            // stays on the EXIT so running again halts again
+            status = CHIP8_HALT;
+            goto done;
+        CASE(LOW)
+            opResolution(state, 0);
+            NEXT(pc + 2);
+        CASE(HIGH)
+            opResolution(state, 1);
+            NEXT(pc + 2);
+        CASE(JP)
+            NEXT(d->nnn);
+        CASE(CALL)
+            if (state->stackPointer >= 16)
+                FAULT(CHIP8_FAULT_STACK_OVERFLOW);
+            PROFILE_CALL(state, d->nnn);
+            state->stack[state->stackPointer++] = pc + 2;
+            NEXT(d->nnn);
+        CASE(SE_VX_NN)
+            NEXT(pc + ((regXY[d->x] == (d->nnn & 0xFF)) ? 4 : 2));
+        CASE(SNE_VX_NN)
+            NEXT(pc + ((regXY[d->x] != (d->nnn & 0xFF)) ? 4 : 2));
+        CASE(SE_VX_VY)
+            NEXT(pc + ((regXY[d->x] == regXY[d->y]) ? 4 : 2));
+        CASE(LD_VX_NN)
+            regXY[d->x] = d->nnn & 0xFF;
+            NEXT(pc + 2);
+        CASE(ADD_VX_NN)
+            regXY[d->x] += d->nnn & 0xFF;
+            NEXT(pc + 2);
+        CASE(LD_VX_VY)
+            regXY[d->x] = regXY[d->y];
+            NEXT(pc + 2);
+        CASE(OR)
+            regXY[d->x] |= regXY[d->y];
+            opLogicFlag(regXY, INTERP_QUIRKS);
+            NEXT(pc + 2);
+        CASE(AND)
+            regXY[d->x] &= regXY[d->y];
+            opLogicFlag(regXY, INTERP_QUIRKS);
+            NEXT(pc + 2);
+        CASE(XOR)
+            regXY[d->x] ^= regXY[d->y];
+            opLogicFlag(regXY, INTERP_QUIRKS);
+            NEXT(pc + 2);
+        CASE(ADD_VX_VY)
+            opAddReg(regXY, d->x, d->y);
+            NEXT(pc + 2);
+        CASE(SUB)
+            opSub(regXY, d->x, d->y);
+            NEXT(pc + 2);
+        CASE(SHR)
+            opShr(regXY, d->x, d->y, INTERP_QUIRKS);
+            NEXT(pc + 2);
+        CASE(SUBN)
+            opSubn(regXY, d->x, d->y);
+            NEXT(pc + 2);
+        CASE(SHL)
+            opShl(regXY, d->x, d->y, INTERP_QUIRKS);
+            NEXT(pc + 2);
+        CASE(SNE_VX_VY)
+            NEXT(pc + ((regXY[d->x] != regXY[d->y]) ? 4 : 2));
+        CASE(LD_I)
+            state->regI = d->nnn;
+            NEXT(pc + 2);
+        CASE(JP_V0)
+            NEXT(d->nnn + regXY[(INTERP_QUIRKS & CHIP8_QUIRK_JUMP_VX) ? d->x : 0]);
+        CASE(RND)
+            opRandom(state, d->x, d->nnn & 0xFF);
+            NEXT(pc + 2);
+        CASE(DRW)
+            if (memFault(state, spriteBytes(state, d->n)))
+                FAULT(CHIP8_FAULT_MEMORY);
+            PROFILE_DRAW(state, d->n);
+            opDraw(state, d->x, d->y, d->n, INTERP_QUIRKS);
+            NEXT(pc + 2);
+        CASE(SKP)
+            NEXT(pc + (((state->keys >> (regXY[d->x] & 0xF)) & 1) ? 4 : 2));
+        CASE(SKNP)
+            NEXT(pc + (((state->keys >> (regXY[d->x] & 0xF)) & 1) ? 2 : 4));
+        CASE(LD_VX_DT)
+            regXY[d->x] = state->delayTimer;
+            // timers only tick between runs, so every further pass of a wait loop is the
+            // same three instructions: skip the whole passes and run the remainder
+#ifndef INTERP_TRACE
+            if (left >= 3 && chip8IdleLoop(state, pc))
+            {
+                long long skip = left - left % 3;
+                left -= skip;
+                state->idleCycles += skip;
+            }
+#endif
+            NEXT(pc + 2);
+        CASE(LD_VX_K)
+            if (!state->keys)
+            {
+                // keys only change between runs, so wait out the rest of this one
+                state->idleCycles += left;
+                left = 0;
+                NEXT(pc);
+            }
+            // lowest held key
+            for (regXY[d->x] = 0; !((state->keys >> regXY[d->x]) & 1); regXY[d->x]++)
+                ;
+            NEXT(pc + 2);
+        CASE(LD_DT_VX)
+            state->delayTimer = regXY[d->x];
+            NEXT(pc + 2);
+        CASE(LD_ST_VX)
+            state->soundTimer = regXY[d->x];
+            NEXT(pc + 2);
+        CASE(ADD_I_VX)
+            state->regI += regXY[d->x];
+            NEXT(pc + 2);
+        CASE(LD_F_VX)
+            state->regI = FONT_ADDR + regXY[d->x] * 5;
+            NEXT(pc + 2);
+        CASE(LD_B_VX)
+            if (memFault(state, 3))
+                FAULT(CHIP8_FAULT_MEMORY);
+            opStoreBcd(state, d->x);
+            NEXT(pc + 2);
+        CASE(LD_MEM_VX)
+            if (memFault(state, d->x + 1))
+                FAULT(CHIP8_FAULT_MEMORY);
+            opStore(state, d->x, INTERP_QUIRKS);
+            NEXT(pc + 2);
+        CASE(LD_VX_MEM)
+            if (memFault(state, d->x + 1))
+                FAULT(CHIP8_FAULT_MEMORY);
+            opLoad(state, d->x, INTERP_QUIRKS);
+            NEXT(pc + 2);
+        CASE(LD_HF_VX)
+            state->regI = BIG_FONT_ADDR + (regXY[d->x] & 0xF) * 10;
+            NEXT(pc + 2);
+        CASE(LD_R_VX)
+            memcpy(state->flags, regXY, d->x + 1);
+            NEXT(pc + 2);
+        CASE(LD_VX_R)
+            memcpy(regXY, state->flags, d->x + 1);
+            NEXT(pc + 2);
+        CASE(PLANE)
+            state->planes = d->x & ((1 << DISPLAY_PLANES) - 1);
+            NEXT(pc + 2);
+        CASE(INVALID)
+            NEXT(pc + 2);
+    }
+
+done:
+#ifdef INTERP_TRACE
+    traceEnd(state->trace, state, status);
+#endif
+    state->pc = pc;
+    state->cycles += cycles - left;
+    return status;
+}
+
+#undef INTERP_NAME
+#undef INTERP_QUIRKS
+#undef INTERP_TRACE
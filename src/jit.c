@@ -0,0 +1,825 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "ops.h"
+#include "jit.h"
+
+// operations of a block body, guards skip the operation after them when their condition holds.
+// quirk variants are picked when translating: _VF clears VF, _VY shifts Vy into Vx, _I
+// advances I and CLIP clips instead of wrapping
+#define JIT_UOPS(X) \
+    X(LD_NN) X(ADD_NN) X(LD_VY) X(OR) X(AND) X(XOR) X(ADD_VY) X(SUB) X(SHR) X(SUBN) X(SHL) \
+    X(LD_I) X(ADD_I) X(LD_F) X(LD_VX_DT) X(LD_DT) X(LD_ST) X(LD_VX_MEM) X(CLS) X(RND) X(DRW) X(NOP) \
+    X(OR_VF) X(AND_VF) X(XOR_VF) X(SHR_VY) X(SHL_VY) X(LD_VX_MEM_I) X(DRW_CLIP) \
+    X(LD_B) X(LD_MEM) X(LD_MEM_I) /* ram writes, stop the block if they hit its own code */ \
+    X(SCD) X(SCU) X(SCR) X(SCL) X(LOW) X(HIGH) X(LD_HF) X(LD_R) X(LD_VX_R) X(PLANE) \
+    X(CALL) X(RET) /* a call followed into the block, and the return from it */ \
+    X(LOOP) /* jump back to the start of the block */ \
+    X(SE_NN) X(SNE_NN) X(SE_VY) X(SNE_VY) X(SKP) X(SKNP) \
+    X(END) /* end of body, continue with the terminator */
+
+#define JIT_UOP_ENUM(name) U_##name,
+enum jit_uop { JIT_UOPS(JIT_UOP_ENUM) U_COUNT };
+
+// how a block ends
+enum jit_term_kind
+{
+    T_NEXT, // ran out of room or ROM, continue at end
+    T_JP,
+    T_CALL,
+    T_RET,
+    T_JP_V0,
+    T_SKIP, // conditional skip at end
+    T_BRANCH, // conditional skip at end over a JP at end+2, fused into a two way branch
+    T_INTERP // instruction at end runs on the interpreter
+};
+
+typedef struct jit_op
+{
+    unsigned char op;
+    unsigned char x;
+    unsigned char y;
+    unsigned char n;
+    unsigned short nnn; // nn for immediate byte operations, the return address for U_CALL
+    unsigned short pc; // address of its first source instruction
+    unsigned char at; // source instructions before it on the block's path
+    unsigned char weight; // source instructions folded into this operation
+    unsigned char guarded; // follows a guard, never folded into
+} jit_op;
+
+typedef struct jit_term
+{
+    unsigned char kind;
+    unsigned char cond; // skip condition as CHIP8_OP_SE_VX_NN etc
+    unsigned char x;
+    unsigned char y;
+    unsigned char nn;
+    unsigned short target;
+    unsigned char v; // register added to target by T_JP_V0
+} jit_term;
+
+typedef struct jit_block
+{
+    unsigned short start;
+    unsigned short end; // address of the terminating instruction, or of the next one for T_NEXT
+    unsigned char valid;
+    unsigned char len; // source instructions in the body
+    unsigned char tail; // most instructions the terminator can execute
+    unsigned char count; // operations in the body, not counting the closing U_END
+    unsigned char idle; // delay timer wait loop, see chip8IdleLoop
+    jit_term term;
+    uint64_t pages;
+    jit_op body[JIT_BLOCK_MAX + 1];
+} jit_block;
+
+struct chip8_jit
+{
+    jit_block slots[JIT_SLOTS];
+    uint64_t codePages; // mirror of the owning state's codePages
+    unsigned char quirks; // profile the blocks were translated for
+    // block the last run's budget ended inside, carried on from resumeOp by the next run
+    // if the machine has not moved since, so loops stay in one block across timer ticks
+    jit_block* resume;
+    unsigned char resumeOp;
+    long long resumeCycles;
+    chip8_jit_stats stats;
+};
+
+chip8_jit* chip8JitCreate(void)
+{
+    return calloc(1, sizeof(chip8_jit));
+}
+
+void chip8JitDestroy(chip8_jit* jit)
+{
+    free(jit);
+}
+
+void chip8JitReset(chip8_jit* jit)
+{
+    for (int i = 0; i < JIT_SLOTS; i++)
+        jit->slots[i].valid = 0;
+    jit->codePages = 0;
+    jit->resume = NULL;
+}
+
+const chip8_jit_stats* chip8JitStats(const chip8_jit* jit)
+{
+    return &jit->stats;
+}
+
+// body operation for a straight-line instruction under the quirks profile, -1 if it
+// changes control flow or waits
+static int straightOp(unsigned char op, unsigned int quirks)
+{
+    int vfReset = (quirks & CHIP8_QUIRK_VF_RESET) != 0;
+    int shiftVy = !(quirks & CHIP8_QUIRK_SHIFT_VX);
+    switch (op)
+    {
+        case CHIP8_OP_LD_VX_NN: return U_LD_NN;
+        case CHIP8_OP_ADD_VX_NN: return U_ADD_NN;
+        case CHIP8_OP_LD_VX_VY: return U_LD_VY;
+        case CHIP8_OP_OR: return vfReset ? U_OR_VF : U_OR;
+        case CHIP8_OP_AND: return vfReset ? U_AND_VF : U_AND;
+        case CHIP8_OP_XOR: return vfReset ? U_XOR_VF : U_XOR;
+        case CHIP8_OP_ADD_VX_VY: return U_ADD_VY;
+        case CHIP8_OP_SUB: return U_SUB;
+        case CHIP8_OP_SHR: return shiftVy ? U_SHR_VY : U_SHR;
+        case CHIP8_OP_SUBN: return U_SUBN;
+        case CHIP8_OP_SHL: return shiftVy ? U_SHL_VY : U_SHL;
+        case CHIP8_OP_LD_I: return U_LD_I;
+        case CHIP8_OP_ADD_I_VX: return U_ADD_I;
+        case CHIP8_OP_LD_F_VX: return U_LD_F;
+        case CHIP8_OP_LD_VX_DT: return U_LD_VX_DT;
+        case CHIP8_OP_LD_DT_VX: return U_LD_DT;
+        case CHIP8_OP_LD_ST_VX: return U_LD_ST;
+        case CHIP8_OP_LD_VX_MEM: return (quirks & CHIP8_QUIRK_KEEP_I) ? U_LD_VX_MEM : U_LD_VX_MEM_I;
+        case CHIP8_OP_CLS: return U_CLS;
+        case CHIP8_OP_RND: return U_RND;
+        case CHIP8_OP_DRW: return (quirks & CHIP8_QUIRK_WRAP) ? U_DRW : U_DRW_CLIP;
+        case CHIP8_OP_LD_B_VX: return U_LD_B;
+        case CHIP8_OP_LD_MEM_VX: return (quirks & CHIP8_QUIRK_KEEP_I) ? U_LD_MEM : U_LD_MEM_I;
+        case CHIP8_OP_SCD: return U_SCD;
+        case CHIP8_OP_SCU: return U_SCU;
+        case CHIP8_OP_SCR: return U_SCR;
+        case CHIP8_OP_SCL: return U_SCL;
+        case CHIP8_OP_LOW: return U_LOW;
+        case CHIP8_OP_HIGH: return U_HIGH;
+        case CHIP8_OP_LD_HF_VX: return U_LD_HF;
+        case CHIP8_OP_LD_R_VX: return U_LD_R;
+        case CHIP8_OP_LD_VX_R: return U_LD_VX_R;
+        case CHIP8_OP_PLANE: return U_PLANE;
+        case CHIP8_OP_SYS:
+        case CHIP8_OP_INVALID: return U_NOP;
+        default: return -1;
+    }
+}
+
+// guard for a conditional skip, -1 if op is not one
+static int guardOp(unsigned char op)
+{
+    switch (op)
+    {
+        case CHIP8_OP_SE_VX_NN: return U_SE_NN;
+        case CHIP8_OP_SNE_VX_NN: return U_SNE_NN;
+        case CHIP8_OP_SE_VX_VY: return U_SE_VY;
+        case CHIP8_OP_SNE_VX_VY: return U_SNE_VY;
+        case CHIP8_OP_SKP: return U_SKP;
+        case CHIP8_OP_SKNP: return U_SKNP;
+        default: return -1;
+    }
+}
+
+static jit_op* append(jit_block* b, unsigned char uop, const chip8_decoded* d, unsigned short pc)
+{
+    jit_op* op = &b->body[b->count++];
+    op->op = uop;
+    op->x = d->x;
+    op->y = d->y;
+    op->n = d->n;
+    op->nnn = (uop == U_LD_NN || uop == U_ADD_NN || uop == U_SE_NN || uop == U_SNE_NN) ? (d->nnn & 0xFF) : d->nnn;
+    op->pc = pc;
+    op->at = b->len;
+    op->weight = 1;
+    op->guarded = 0;
+    b->len++;
+    return op;
+}
+
+// a jump followed into the block does nothing when it runs, so it rides on the previous
+// operation like a fused instruction. not on a store, which may overwrite the jump
+static void emitJump(chip8_jit* jit, jit_block* b, const chip8_decoded* d, unsigned short pc)
+{
+    const jit_op* prev = b->count ? &b->body[b->count-1] : NULL;
+    if (prev && !prev->guarded && prev->op != U_LD_B && prev->op != U_LD_MEM && prev->op != U_LD_MEM_I)
+    {
+        b->body[b->count-1].weight++;
+        b->len++;
+        jit->stats.fused++;
+    }
+    else
+        append(b, U_NOP, d, pc);
+}
+
+// append op to the body, folding it into the previous operation where possible
+static void emit(chip8_jit* jit, jit_block* b, unsigned char uop, const chip8_decoded* d, unsigned short pc)
+{
+    jit_op* prev = (b->count && !b->body[b->count-1].guarded) ? &b->body[b->count-1] : NULL;
+    unsigned char nn = d->nnn & 0xFF;
+
+    if (prev && prev->x == d->x && (prev->op == U_LD_NN || prev->op == U_ADD_NN))
+    {
+        // LD Vx, a; ADD Vx, b -> LD Vx, a+b and ADD Vx, a; ADD Vx, b -> ADD Vx, a+b
+        if (uop == U_ADD_NN)
+        {
+            prev->nnn = (prev->nnn + nn) & 0xFF;
+            prev->weight++;
+            b->len++;
+            jit->stats.fused++;
+            return;
+        }
+        // 7XNN leaves VF alone so LD/ADD Vx followed by LD Vx is just the LD
+        if (uop == U_LD_NN)
+        {
+            prev->op = U_LD_NN;
+            prev->nnn = nn;
+            prev->weight++;
+            b->len++;
+            jit->stats.fused++;
+            return;
+        }
+    }
+    if (prev && uop == U_LD_I && prev->op == U_LD_I)
+    {
+        prev->nnn = d->nnn;
+        prev->weight++;
+        b->len++;
+        jit->stats.fused++;
+        return;
+    }
+    append(b, uop, d, pc);
+}
+
+static const chip8_decoded* decodedAt(chip8_state* state, unsigned short addr)
+{
+    chip8_decoded* d = &state->decoded[addr];
+    if (d->op == CHIP8_OP_DECODE)
+        chip8Decode((((unsigned short)state->ram[addr]) << 8) | ((unsigned short)state->ram[(addr+1) & (MEM_SIZE-1)]), d);
+    return d;
+}
+
+static uint64_t pageMask(unsigned int from, unsigned int to)
+{
+    uint64_t mask = 0;
+    for (unsigned int page = from / CODE_PAGE; page <= (to - 1) / CODE_PAGE; page++)
+        mask |= 1ULL << page;
+    return mask;
+}
+
+// nonzero if addr was already translated into the block, so following a jump there
+// would loop inside it
+static int visited(const unsigned short (*segs)[2], int segCount, unsigned int addr)
+{
+    for (int i = 0; i < segCount; i++)
+    {
+        if (addr >= segs[i][0] && addr < segs[i][1])
+            return 1;
+    }
+    return 0;
+}
+
+// translate the code from pc, following jumps, calls and the returns matching those calls
+// into one block until a loop closes, a conditional or computed branch, or JIT_BLOCK_MAX
+static void translate(chip8_jit* jit, chip8_state* state, jit_block* b, unsigned short pc)
+{
+    unsigned int romEnd = state->romSize + START_ADDR;
+    unsigned int addr = pc;
+    unsigned int codeEnd;
+    unsigned int segStart = pc; // start of the range being translated
+    unsigned short segs[JIT_BLOCK_MAX + 1][2]; // ranges translated before it
+    int segCount = 0;
+    unsigned short rets[JIT_BLOCK_MAX]; // return addresses of calls followed
+    int depth = 0;
+    jit_term* t = &b->term;
+
+    if (jit->resume == b)
+        jit->resume = NULL;
+    b->start = pc;
+    b->len = 0;
+    b->count = 0;
+    b->pages = 0;
+    memset(t, 0, sizeof(*t));
+    t->kind = T_NEXT;
+
+    while (addr < romEnd && b->len < JIT_BLOCK_MAX)
+    {
+        const chip8_decoded* d = decodedAt(state, addr);
+        int uop = straightOp(d->op, state->quirks);
+        if (uop >= 0)
+        {
+            emit(jit, b, uop, d, addr);
+            addr += 2;
+            continue;
+        }
+
+        int guard = guardOp(d->op);
+        if (guard >= 0)
+        {
+            const chip8_decoded* skipped = addr + 2 < romEnd ? decodedAt(state, addr + 2) : NULL;
+            int skippedOp = skipped ? straightOp(skipped->op, state->quirks) : -1;
+            // skip over a straight-line instruction: guard it and keep going
+            if (skippedOp >= 0 && b->len + 2 <= JIT_BLOCK_MAX)
+            {
+                append(b, guard, d, addr);
+                append(b, skippedOp, skipped, addr + 2)->guarded = 1;
+                jit->stats.fused++;
+                addr += 4;
+                continue;
+            }
+            // skip over a jump back to the start: the loop runs inside the block, except
+            // for delay timer wait loops, which the terminator fast-forwards
+            int idle = b->len == 1 && b->body[0].op == U_LD_VX_DT && b->body[0].x == d->x
+                && (d->op == CHIP8_OP_SE_VX_NN || d->op == CHIP8_OP_SNE_VX_NN);
+            if (skipped && skipped->op == CHIP8_OP_JP && skipped->nnn == pc && !idle && b->len + 2 <= JIT_BLOCK_MAX)
+            {
+                append(b, guard, d, addr);
+                append(b, U_LOOP, skipped, addr + 2)->guarded = 1;
+                addr += 4;
+                continue;
+            }
+            // skip over a jump, the usual loop condition
+            if (skipped && skipped->op == CHIP8_OP_JP)
+            {
+                t->kind = T_BRANCH;
+                t->target = skipped->nnn;
+            }
+            else
+                t->kind = T_SKIP;
+            t->cond = d->op;
+            t->x = d->x;
+            t->y = d->y;
+            t->nn = d->nnn & 0xFF;
+            break;
+        }
+
+        // a jump back to the start closes a loop run inside the block
+        if (d->op == CHIP8_OP_JP && d->nnn == pc && b->len > 0)
+        {
+            append(b, U_LOOP, d, addr);
+            addr += 2;
+            break;
+        }
+
+        // follow a jump, a call, or a return from a call followed earlier, unless the code
+        // there is already in the block
+        unsigned int target = d->op == CHIP8_OP_RET ? (depth ? rets[depth-1] : MEM_SIZE) : d->nnn;
+        int follow = (d->op == CHIP8_OP_JP || d->op == CHIP8_OP_CALL || d->op == CHIP8_OP_RET)
+            && target < MEM_SIZE && b->len < JIT_BLOCK_MAX;
+        if (follow)
+        {
+            segs[segCount][0] = segStart;
+            segs[segCount][1] = addr + 2;
+            follow = !visited(segs, segCount + 1, target);
+        }
+        if (follow)
+        {
+            if (d->op == CHIP8_OP_JP)
+                emitJump(jit, b, d, addr);
+            else if (d->op == CHIP8_OP_CALL)
+            {
+                append(b, U_CALL, d, addr)->nnn = addr + 2;
+                rets[depth++] = addr + 2;
+            }
+            else
+            {
+                append(b, U_RET, d, addr);
+                depth--;
+            }
+            b->pages |= pageMask(segStart, addr + 2);
+            segCount++;
+            segStart = addr = target;
+            continue;
+        }
+
+        switch (d->op)
+        {
+            case CHIP8_OP_JP: t->kind = T_JP; t->target = d->nnn; break;
+            case CHIP8_OP_CALL: t->kind = T_CALL; t->target = d->nnn; break;
+            case CHIP8_OP_RET: t->kind = T_RET; break;
+            case CHIP8_OP_JP_V0:
+                t->kind = T_JP_V0;
+                t->target = d->nnn;
+                t->v = (state->quirks & CHIP8_QUIRK_JUMP_VX) ? d->x : 0;
+                break;
+            default: t->kind = T_INTERP; break;
+        }
+        break;
+    }
+    b->body[b->count].op = U_END;
+    b->body[b->count].pc = addr;
+    b->body[b->count].at = b->len;
+    b->body[b->count].weight = 0;
+
+    b->end = addr;
+    codeEnd = addr;
+    if (t->kind == T_BRANCH)
+        codeEnd += 4;
+    else if (t->kind != T_NEXT)
+        codeEnd += 2;
+    if (codeEnd > MEM_SIZE)
+        codeEnd = MEM_SIZE;
+    if (codeEnd > segStart)
+        b->pages |= pageMask(segStart, codeEnd);
+    b->idle = t->kind == T_BRANCH && t->target == pc && b->len == 1 && b->body[0].op == U_LD_VX_DT
+        && b->body[0].x == t->x && (t->cond == CHIP8_OP_SE_VX_NN || t->cond == CHIP8_OP_SNE_VX_NN);
+    b->tail = t->kind == T_NEXT ? 0 : t->kind == T_BRANCH ? 2 : 1;
+    b->valid = 1;
+
+    state->codePages |= b->pages;
+    jit->codePages = state->codePages;
+    jit->stats.translations++;
+}
+
+// drop blocks whose code was written since they were translated
+static void flushDirty(chip8_jit* jit, chip8_state* state)
+{
+    uint64_t live = 0;
+    for (int i = 0; i < JIT_SLOTS; i++)
+    {
+        jit_block* b = &jit->slots[i];
+        if (!b->valid)
+            continue;
+        if (b->pages & state->dirtyPages)
+        {
+            if (jit->resume == b)
+                jit->resume = NULL;
+            b->valid = 0;
+            jit->stats.invalidations++;
+        }
+        else
+            live |= b->pages;
+    }
+    state->dirtyPages = 0;
+    state->codePages = live;
+    jit->codePages = live;
+}
+
+static inline int skipTaken(unsigned char cond, unsigned char x, unsigned char y, unsigned char nn, const chip8_state* state)
+{
+    const unsigned char* regXY = state->regXY;
+    switch (cond)
+    {
+        case CHIP8_OP_SE_VX_NN: return regXY[x] == nn;
+        case CHIP8_OP_SNE_VX_NN: return regXY[x] != nn;
+        case CHIP8_OP_SE_VX_VY: return regXY[x] == regXY[y];
+        case CHIP8_OP_SKP: return (state->keys >> (regXY[x] & 0xF)) & 1;
+        case CHIP8_OP_SKNP: return !((state->keys >> (regXY[x] & 0xF)) & 1);
+        default: return regXY[x] != regXY[y];
+    }
+}
+
+// why runBody returned
+enum jit_exit
+{
+    EXIT_END, // ran the whole body
+    EXIT_BUDGET, // the next operation would run past the cycle budget
+    EXIT_WRITE, // a store wrote the block's own code
+    EXIT_FAULT // state->fault says why
+};
+
+// threaded dispatch over the body, computed goto where the compiler supports it
+#ifdef __GNUC__
+#define JIT_UOP_LABEL(name) &&u_##name,
+#define DISPATCH(op) goto *handlers[op];
+#define CASE(name) u_##name:
+// straight to the next handler until the budget might run out
+#define NEXT(count) do { op += (count); if (op >= bound) goto next; goto *handlers[op->op]; } while (0)
+#else
+#define DISPATCH(op) switch (op)
+#define CASE(name) case U_##name:
+#define NEXT(count) do { op += (count); goto next; } while (0)
+#endif
+#define FAULT(kind) do { state->fault = (kind); *exit = EXIT_FAULT; goto stop; } while (0)
+
+// first operation from op on that might not fit once reach instructions from the start of
+// the pass have run, or one past U_END if the rest of the body fits
+static inline const jit_op* horizon(const jit_block* b, const jit_op* op, long long reach)
+{
+    if (b->len <= reach)
+        return b->body + b->count + 1;
+    while (op->at + op->weight <= reach)
+        op++;
+    return op;
+}
+
+// run the body from *cursor for at most budget instructions, returns the number executed
+// and sets *exit. *cursor is left on the operation it stopped before: the one past the
+// budget, after a store into the block, or the faulting one, which is not counted
+static inline long long runBody(chip8_state* state, const jit_block* b, const jit_op** cursor, long long budget, int* exit)
+{
+    unsigned char* regXY = state->regXY;
+    const jit_op* op = *cursor;
+    // instructions before the first operation or skipped by guards, less those of earlier
+    // passes round a loop
+    long long skipped = op->at;
+#ifdef __GNUC__
+    static const void* const handlers[U_COUNT] = { JIT_UOPS(JIT_UOP_LABEL) };
+#endif
+    // guards only skip more, so everything before bound fits whatever they do
+    const jit_op* bound = horizon(b, op, budget + skipped);
+
+next:
+    if (op >= bound)
+    {
+        // the source instructions through this operation, less those skipped
+        if (op->at + op->weight - skipped > budget)
+        {
+            *exit = EXIT_BUDGET;
+            goto stop;
+        }
+        bound = horizon(b, op, budget + skipped);
+    }
+    DISPATCH(op->op)
+    {
+        CASE(LD_NN) regXY[op->x] = op->nnn; NEXT(1);
+        CASE(ADD_NN) regXY[op->x] += op->nnn; NEXT(1);
+        CASE(LD_VY) regXY[op->x] = regXY[op->y]; NEXT(1);
+        CASE(OR) regXY[op->x] |= regXY[op->y]; NEXT(1);
+        CASE(AND) regXY[op->x] &= regXY[op->y]; NEXT(1);
+        CASE(XOR) regXY[op->x] ^= regXY[op->y]; NEXT(1);
+        CASE(ADD_VY) opAddReg(regXY, op->x, op->y); NEXT(1);
+        CASE(SUB) opSub(regXY, op->x, op->y); NEXT(1);
+        CASE(SHR) opShr(regXY, op->x, op->y, CHIP8_QUIRK_SHIFT_VX); NEXT(1);
+        CASE(SUBN) opSubn(regXY, op->x, op->y); NEXT(1);
+        CASE(SHL) opShl(regXY, op->x, op->y, CHIP8_QUIRK_SHIFT_VX); NEXT(1);
+        CASE(LD_I) state->regI = op->nnn; NEXT(1);
+        CASE(ADD_I) state->regI += regXY[op->x]; NEXT(1);
+        CASE(LD_F) state->regI = FONT_ADDR + regXY[op->x] * 5; NEXT(1);
+        CASE(LD_VX_DT) regXY[op->x] = state->delayTimer; NEXT(1);
+        CASE(LD_DT) state->delayTimer = regXY[op->x]; NEXT(1);
+        CASE(LD_ST) state->soundTimer = regXY[op->x]; NEXT(1);
+        CASE(LD_VX_MEM) if (memFault(state, op->x + 1)) FAULT(CHIP8_FAULT_MEMORY); opLoad(state, op->x, CHIP8_QUIRK_KEEP_I); NEXT(1);
+        CASE(CLS) opClear(state); NEXT(1);
+        CASE(RND) opRandom(state, op->x, op->nnn & 0xFF); NEXT(1);
+        CASE(DRW) if (memFault(state, spriteBytes(state, op->n))) FAULT(CHIP8_FAULT_MEMORY); opDraw(state, op->x, op->y, op->n, CHIP8_QUIRK_WRAP); NEXT(1);
+        CASE(NOP) NEXT(1);
+        CASE(OR_VF) regXY[op->x] |= regXY[op->y]; regXY[0xF] = 0; NEXT(1);
+        CASE(AND_VF) regXY[op->x] &= regXY[op->y]; regXY[0xF] = 0; NEXT(1);
+        CASE(XOR_VF) regXY[op->x] ^= regXY[op->y]; regXY[0xF] = 0; NEXT(1);
+        CASE(SHR_VY) opShr(regXY, op->x, op->y, 0); NEXT(1);
+        CASE(SHL_VY) opShl(regXY, op->x, op->y, 0); NEXT(1);
+        CASE(LD_VX_MEM_I) if (memFault(state, op->x + 1)) FAULT(CHIP8_FAULT_MEMORY); opLoad(state, op->x, 0); NEXT(1);
+        CASE(DRW_CLIP) if (memFault(state, spriteBytes(state, op->n))) FAULT(CHIP8_FAULT_MEMORY); opDraw(state, op->x, op->y, op->n, 0); NEXT(1);
+        CASE(LD_B) if (memFault(state, 3)) FAULT(CHIP8_FAULT_MEMORY); opStoreBcd(state, op->x); goto written;
+        CASE(LD_MEM) if (memFault(state, op->x + 1)) FAULT(CHIP8_FAULT_MEMORY); opStore(state, op->x, CHIP8_QUIRK_KEEP_I); goto written;
+        CASE(LD_MEM_I) if (memFault(state, op->x + 1)) FAULT(CHIP8_FAULT_MEMORY); opStore(state, op->x, 0); goto written;
+        CASE(SCD) opScrollRows(state, op->n); NEXT(1);
+        CASE(SCU) opScrollRows(state, -op->n); NEXT(1);
+        CASE(SCR) opScrollColumns(state, 1); NEXT(1);
+        CASE(SCL) opScrollColumns(state, 0); NEXT(1);
+        CASE(LOW) opResolution(state, 0); NEXT(1);
+        CASE(HIGH) opResolution(state, 1); NEXT(1);
+        CASE(LD_HF) state->regI = BIG_FONT_ADDR + (regXY[op->x] & 0xF) * 10; NEXT(1);
+        CASE(LD_R) memcpy(state->flags, regXY, op->x + 1); NEXT(1);
+        CASE(LD_VX_R) memcpy(regXY, state->flags, op->x + 1); NEXT(1);
+        CASE(PLANE) state->planes = op->x & ((1 << DISPLAY_PLANES) - 1); NEXT(1);
+        CASE(CALL)
+            if (state->stackPointer >= 16)
+                FAULT(CHIP8_FAULT_STACK_OVERFLOW);
+            state->stack[state->stackPointer++] = op->nnn;
+            NEXT(1);
+        // the call it returns from pushed the address the block continues at
+        CASE(RET) state->stackPointer--; NEXT(1);
+        CASE(LOOP)
+            skipped -= op->at + op->weight;
+            op = b->body;
+            bound = horizon(b, op, budget + skipped);
+            NEXT(0);
+        // a taken guard skips the operation after it, which is never folded so counts one
+        CASE(SE_NN) if (regXY[op->x] == op->nnn) { skipped++; NEXT(2); } NEXT(1);
+        CASE(SNE_NN) if (regXY[op->x] != op->nnn) { skipped++; NEXT(2); } NEXT(1);
+        CASE(SE_VY) if (regXY[op->x] == regXY[op->y]) { skipped++; NEXT(2); } NEXT(1);
+        CASE(SNE_VY) if (regXY[op->x] != regXY[op->y]) { skipped++; NEXT(2); } NEXT(1);
+        CASE(SKP) if ((state->keys >> (regXY[op->x] & 0xF)) & 1) { skipped++; NEXT(2); } NEXT(1);
+        CASE(SKNP) if (!((state->keys >> (regXY[op->x] & 0xF)) & 1)) { skipped++; NEXT(2); } NEXT(1);
+        CASE(END) *exit = EXIT_END; goto stop;
+    }
+    *exit = EXIT_END;
+
+written:
+    if (!(state->dirtyPages & b->pages))
+        NEXT(1);
+    op++;
+    // the rest of the block may be stale
+    *exit = EXIT_WRITE;
+stop:
+    *cursor = op;
+    return op->at - skipped;
+}
+
+#undef DISPATCH
+#undef CASE
+#undef NEXT
+#undef FAULT
+
+// nonzero if the translator can run state, dropping the blocks if they were translated
+// for another machine
+static int usable(chip8_jit* jit, chip8_state* state)
+{
+#ifdef CHIP8_PROFILE
+    // only the interpreter is instrumented
+    if (state->profile)
+        return 0;
+#endif
+    // likewise traced
+    if (state->trace)
+        return 0;
+
+    // blocks belong to another machine, one that was reinitialized or another profile
+    if (state->codePages != jit->codePages || state->quirks != jit->quirks)
+    {
+        chip8JitReset(jit);
+        jit->quirks = state->quirks;
+        state->codePages = 0;
+        state->dirtyPages = 0;
+    }
+    return 1;
+}
+
+// run cycles instructions, or fewer if the ROM stops, ticking the timers every tickInsts
+// instructions when it is not 0. a budget ending inside a block leaves it ready to carry
+// on from, so a loop stays in its block across ticks
+static int runBlocks(chip8_jit* jit, chip8_state* state, long long cycles, int tickInsts)
+{
+    unsigned int romEnd = state->romSize + START_ADDR;
+    unsigned short pc = state->pc;
+    long long end = state->cycles + cycles;
+    long long lookups = 0;
+    long long translations = jit->stats.translations;
+    int status = CHIP8_OK;
+    jit_block* b = NULL;
+    const jit_op* from = NULL;
+
+    if (jit->resume && jit->resumeCycles == state->cycles && !state->dirtyPages && jit->resume->body[jit->resumeOp].pc == pc)
+    {
+        b = jit->resume;
+        from = &b->body[jit->resumeOp];
+    }
+    jit->resume = NULL;
+
+    // cycle count of the next timer tick, kept instead of dividing for every slice
+    long long tick = tickInsts ? state->cycles - state->cycles % tickInsts + tickInsts : end;
+    while (status == CHIP8_OK && state->cycles < end)
+    {
+        // up to the next timer tick, state->cycles is brought up to date after each
+        long long slice = (tick < end ? tick : end) - state->cycles;
+        long long left = slice;
+
+        while (left > 0)
+        {
+            if (from == NULL)
+            {
+                if (state->dirtyPages)
+                    flushDirty(jit, state);
+                if (pc >= romEnd)
+                {
+                    status = CHIP8_HALT;
+                    break;
+                }
+                b = &jit->slots[(pc >> 1) & (JIT_SLOTS-1)];
+                lookups++;
+                if (!b->valid || b->start != pc)
+                    translate(jit, state, b, pc);
+                from = b->body;
+            }
+
+            int exit;
+            long long ran = runBody(state, b, &from, left, &exit);
+            left -= ran;
+            pc = from->pc;
+            if (exit == EXIT_FAULT)
+            {
+                from = NULL;
+                status = CHIP8_FAULT;
+                break;
+            }
+            if (exit == EXIT_WRITE)
+            {
+                from = NULL;
+                continue;
+            }
+            // the budget ends inside the block: carry on from here after the tick, unless
+            // part of the next operation or of the terminator fits, which the interpreter runs
+            if (exit == EXIT_BUDGET || left < b->tail)
+            {
+                jit->stats.partial++;
+                if (left == 0)
+                    break;
+                jit->stats.fallbacks++;
+                from = NULL;
+                state->cycles += slice - left;
+                state->pc = pc;
+                status = chip8Run(state, left);
+                pc = state->pc;
+                slice = left = 0;
+                break;
+            }
+            from = NULL;
+
+            const jit_term* t = &b->term;
+            switch (t->kind)
+            {
+                case T_NEXT:
+                    pc = b->end;
+                    break;
+                case T_JP:
+                    pc = t->target;
+                    left--;
+                    // a lone jump to itself spins until the budget is used up, nothing else changes
+                    if (pc == b->start && b->count == 0)
+                        left = 0;
+                    break;
+                case T_CALL:
+                    if (state->stackPointer >= 16)
+                    {
+                        state->fault = CHIP8_FAULT_STACK_OVERFLOW;
+                        status = CHIP8_FAULT;
+                        pc = b->end;
+                        break;
+                    }
+                    state->stack[state->stackPointer++] = b->end + 2;
+                    pc = t->target;
+                    left--;
+                    break;
+                case T_RET:
+                    if (state->stackPointer == 0)
+                    {
+                        state->fault = CHIP8_FAULT_STACK_UNDERFLOW;
+                        status = CHIP8_FAULT;
+                        pc = b->end;
+                        break;
+                    }
+                    pc = state->stack[--state->stackPointer];
+                    left--;
+                    break;
+                case T_JP_V0:
+                    pc = t->target + state->regXY[t->v];
+                    left--;
+                    break;
+                case T_SKIP:
+                    pc = b->end + (skipTaken(t->cond, t->x, t->y, t->nn, state) ? 4 : 2);
+                    left--;
+                    break;
+                case T_BRANCH:
+                    if (skipTaken(t->cond, t->x, t->y, t->nn, state))
+                    {
+                        pc = b->end + 4;
+                        left--;
+                    }
+                    else
+                    {
+                        // the jump executes too
+                        pc = t->target;
+                        left -= 2;
+                        // still waiting on the delay timer, which cannot change before the
+                        // tick, if the body read it since the last one
+                        if (b->idle && ran)
+                        {
+                            long long skip = left - left % 3;
+                            left -= skip;
+                            state->idleCycles += skip;
+                        }
+                    }
+                    break;
+                case T_INTERP:
+                {
+                    long long before;
+                    state->cycles += slice - left;
+                    state->pc = b->end;
+                    before = state->cycles;
+                    status = chip8Run(state, 1);
+                    left -= state->cycles - before;
+                    slice = left;
+                    pc = state->pc;
+                    break;
+                }
+            }
+            if (status != CHIP8_OK)
+                break;
+        }
+
+        state->cycles += slice - left;
+        state->pc = pc;
+        if (status == CHIP8_OK && tickInsts && state->cycles == tick)
+        {
+            chip8TickTimers(state);
+            tick += tickInsts;
+        }
+    }
+
+    // a later run picks up where this one's budget ran out
+    if (from != NULL)
+    {
+        jit->resume = b;
+        jit->resumeOp = from - b->body;
+        jit->resumeCycles = state->cycles;
+    }
+    jit->stats.lookups += lookups;
+    jit->stats.hits += lookups - (jit->stats.translations - translations);
+    return status;
+}
+
+int chip8JitRun(chip8_jit* jit, chip8_state* state, long long cycles)
+{
+    if (!usable(jit, state))
+        return chip8Run(state, cycles);
+    return runBlocks(jit, state, cycles, 0);
+}
+
+int chip8JitRunTicked(chip8_jit* jit, chip8_state* state, long long cycles, int tickInsts)
+{
+    if (!usable(jit, state))
+        return chip8RunTicked(state, cycles, tickInsts);
+    return runBlocks(jit, state, cycles, tickInsts);
+}
@@ -0,0 +1,40 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "chip8.h"
+
+// block translator: straight-line runs of instructions are translated once into a list of
+// fused operations and cached by start address. jumps, calls and the returns from those
+// calls are followed into the same block, which ends at a conditional or computed branch
+// or where it would loop back into itself. blocks are dropped when FX33/FX55 write into
+// their pages. a cycle budget ending inside a block runs the operations that fit, and
+// only key waits, EXIT and the last instruction or two of a cut short block run on the
+// interpreter.
+
+#define JIT_BLOCK_MAX 32 // instructions per block
+#define JIT_SLOTS 256 // direct mapped on start address
+
+typedef struct chip8_jit_stats
+{
+    long long lookups;
+    long long hits;
+    long long translations;
+    long long fused; // instructions folded into the previous operation
+    long long invalidations; // blocks dropped because their code was written
+    long long partial; // blocks cut short by the end of the cycle budget
+    long long fallbacks; // times the interpreter ran the last instructions of the budget
+} chip8_jit_stats;
+
+typedef struct chip8_jit chip8_jit;
+
+chip8_jit* chip8JitCreate(void);
+void chip8JitDestroy(chip8_jit* jit);
+// drop every block, needed before reusing a translator for a different machine
+void chip8JitReset(chip8_jit* jit);
+// drop-in for chip8Run
+int chip8JitRun(chip8_jit* jit, chip8_state* state, long long cycles);
+// same as chip8RunTicked but through the translator
+int chip8JitRunTicked(chip8_jit* jit, chip8_state* state, long long cycles, int tickInsts);
+const chip8_jit_stats* chip8JitStats(const chip8_jit* jit);
+
+#endif
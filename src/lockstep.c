@@ -0,0 +1,630 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "chip8.h"
+#include "ops.h"
+#include "lockstep.h"
+
+#define W LOCKSTEP_WIDTH
+#define LOCKSTEP_SPIN 2000 // polls of the step counter before a parked thread sleeps
+
+// one group of lanes, every array indexed by lane last so the loops over lanes are
+// contiguous and have a constant trip count the compiler can vectorize
+typedef struct lockstep_group
+{
+    unsigned char v[16][W];
+    unsigned short pc[W];
+    unsigned short regI[W];
+    unsigned char delayTimer[W];
+    unsigned char soundTimer[W];
+    unsigned char sp[W];
+    unsigned short stack[16][W];
+    uint16_t keys[W];
+    uint32_t rng[W];
+    unsigned char status[W];
+    int left[W]; // instructions left in the current frame
+    uint64_t writtenPages; // CODE_PAGE pages a lane wrote, where lanes may hold different code
+    lockstep_stats stats;
+    uint64_t display[W][DISPLAY_H];
+    unsigned char ram[W][MEM_SIZE];
+} lockstep_group;
+
+struct chip8_lockstep
+{
+    int lanes;
+    int groupCount;
+    int threads;
+    unsigned int quirks;
+    unsigned int romEnd;
+    long romSize;
+    int tickInsts; // of the step in progress
+    unsigned char image[MEM_SIZE]; // ram at power on
+    chip8_decoded decoded[MEM_SIZE]; // of image, valid at pages no lane of a group wrote
+    lockstep_group* groups;
+
+    // threads - 1 workers started once and parked between steps. a step posts itself by
+    // bumping steps, then every thread, the caller included, claims groups from nextGroup
+    // until none are left. the caller waits for busy to reach 0
+    int workers;
+    pthread_t* tids;
+    pthread_mutex_t lock;
+    pthread_cond_t posted; // steps changed or closing set
+    pthread_cond_t finished; // busy reached 0
+    unsigned int steps;
+    int nextGroup;
+    int busy; // workers still on the current step
+    int closing;
+};
+
+// loop over the lanes of a group, m[i] is 0xFF for the lanes the instruction runs on
+#define LANES(body) for (int i = 0; i < W; i++) { body; }
+#define BLEND8(old, value) (unsigned char)(((old) & ~m[i]) | ((value) & m[i]))
+#define BLEND16(old, value) (unsigned short)(((old) & ~m16[i]) | ((value) & m16[i]))
+#define ADVANCE(step) LANES(g->pc[i] += m16[i] & (step))
+
+static void startWorkers(chip8_lockstep* ls);
+
+static unsigned short fetch(const unsigned char* ram, unsigned int addr)
+{
+    return (((unsigned short)ram[addr & (MEM_SIZE-1)]) << 8) | ram[(addr+1) & (MEM_SIZE-1)];
+}
+
+chip8_lockstep* lockstepCreate(int lanes, const unsigned char* rom, long romSize, unsigned int quirks, int threads)
+{
+    if (lanes <= 0)
+        return NULL;
+    chip8_lockstep* ls = calloc(1, sizeof(chip8_lockstep));
+    if (ls == NULL)
+        return NULL;
+    ls->lanes = lanes;
+    ls->groupCount = (lanes + W - 1) / W;
+    ls->threads = threads;
+    ls->quirks = quirks;
+    ls->groups = calloc(ls->groupCount, sizeof(lockstep_group));
+    if (ls->groups == NULL)
+    {
+        free(ls);
+        return NULL;
+    }
+
+    // power on image from a scratch machine: font and ROM
+    chip8_state* scratch = malloc(sizeof(chip8_state));
+    if (scratch == NULL)
+    {
+        lockstepDestroy(ls);
+        return NULL;
+    }
+    chip8Init(scratch, NULL);
+    ls->romSize = chip8LoadRomBuffer(scratch, rom, romSize);
+    ls->romEnd = START_ADDR + ls->romSize;
+    memcpy(ls->image, scratch->ram, MEM_SIZE);
+    free(scratch);
+    for (unsigned int addr = 0; addr < MEM_SIZE; addr++)
+        chip8Decode(fetch(ls->image, addr), &ls->decoded[addr]);
+
+    lockstepReset(ls, NULL, CHIP8_DEFAULT_SEED);
+    startWorkers(ls);
+    return ls;
+}
+
+void lockstepDestroy(chip8_lockstep* ls)
+{
+    if (ls == NULL)
+        return;
+    if (ls->tids)
+    {
+        pthread_mutex_lock(&ls->lock);
+        ls->closing = 1;
+        pthread_cond_broadcast(&ls->posted);
+        pthread_mutex_unlock(&ls->lock);
+        for (int t = 0; t < ls->workers; t++)
+            pthread_join(ls->tids[t], NULL);
+        pthread_cond_destroy(&ls->finished);
+        pthread_cond_destroy(&ls->posted);
+        pthread_mutex_destroy(&ls->lock);
+        free(ls->tids);
+    }
+    free(ls->groups);
+    free(ls);
+}
+
+int lockstepLanes(const chip8_lockstep* ls)
+{
+    return ls->lanes;
+}
+
+void lockstepReset(chip8_lockstep* ls, const unsigned char* mask, uint32_t seed)
+{
+    for (int gi = 0; gi < ls->groupCount; gi++)
+    {
+        lockstep_group* g = &ls->groups[gi];
+        int all = 1;
+        for (int i = 0; i < W; i++)
+        {
+            int lane = gi * W + i;
+            if (lane >= ls->lanes)
+            {
+                // padding of the last group never runs
+                g->status[i] = CHIP8_HALT;
+                continue;
+            }
+            if (mask && !mask[lane])
+            {
+                all = 0;
+                continue;
+            }
+            for (int r = 0; r < 16; r++)
+            {
+                g->v[r][i] = 0;
+                g->stack[r][i] = 0;
+            }
+            g->pc[i] = START_ADDR;
+            g->regI[i] = 0;
+            g->delayTimer[i] = 0;
+            g->soundTimer[i] = 0;
+            g->sp[i] = 0;
+            g->keys[i] = 0;
+            // same rule as chip8Seed
+            g->rng[i] = (seed + lane) ? seed + lane : CHIP8_DEFAULT_SEED;
+            g->status[i] = CHIP8_OK;
+            memset(g->display[i], 0, sizeof(g->display[i]));
+            memcpy(g->ram[i], ls->image, MEM_SIZE);
+        }
+        // with every lane back on the image its code is shared again
+        if (all)
+            g->writtenPages = 0;
+    }
+}
+
+void lockstepSetKeys(chip8_lockstep* ls, const uint16_t* keys)
+{
+    for (int lane = 0; lane < ls->lanes; lane++)
+        ls->groups[lane / W].keys[lane % W] = keys[lane];
+}
+
+static void markWritten(lockstep_group* g, unsigned int addr, int len)
+{
+    for (int k = 0; k < len; k++)
+        g->writtenPages |= 1ULL << (((addr + k) & (MEM_SIZE-1)) / CODE_PAGE);
+}
+
+// stop a lane on the instruction at its pc, as the interpreter does on CHIP8_FAULT
+static void laneFault(lockstep_group* g, int i)
+{
+    g->status[i] = CHIP8_FAULT;
+    g->left[i] = 0;
+}
+
+// the instruction on a single lane, for everything the masked loops do not cover
+static void runLane(const chip8_lockstep* ls, lockstep_group* g, int i, const chip8_decoded* d)
+{
+    unsigned int quirks = ls->quirks;
+    unsigned short pc = g->pc[i];
+    unsigned char* ram = g->ram[i];
+    unsigned short regI = g->regI[i];
+
+    switch (d->op)
+    {
+        case CHIP8_OP_CLS:
+            memset(g->display[i], 0, sizeof(g->display[i]));
+            pc += 2;
+            break;
+        case CHIP8_OP_RET:
+            if (g->sp[i] == 0)
+            {
+                laneFault(g, i);
+                return;
+            }
+            pc = g->stack[--g->sp[i]][i];
+            break;
+        case CHIP8_OP_CALL:
+            if (g->sp[i] >= 16)
+            {
+                laneFault(g, i);
+                return;
+            }
+            g->stack[g->sp[i]++][i] = pc + 2;
+            pc = d->nnn;
+            break;
+        case CHIP8_OP_JP_V0:
+            pc = d->nnn + g->v[(quirks & CHIP8_QUIRK_JUMP_VX) ? d->x : 0][i];
+            break;
+        case CHIP8_OP_DRW:
+        {
+            // same as opDraw in lores mode with one plane, on this lane's rows
+            int wide = (d->n == 0);
+            int rows = wide ? 16 : d->n;
+            if (regI + (wide ? 32 : rows) > MEM_SIZE)
+            {
+                laneFault(g, i);
+                return;
+            }
+            const unsigned char* sprite = &ram[regI];
+            unsigned char x = g->v[d->x][i] % DISPLAY_W;
+            unsigned char y = g->v[d->y][i] % DISPLAY_H;
+            int first = (y + rows > DISPLAY_H) ? DISPLAY_H - y : rows;
+            uint64_t collide = blitRows(&g->display[i][y], sprite, first, wide, x, quirks);
+            if (quirks & CHIP8_QUIRK_WRAP)
+                collide |= blitRows(g->display[i], sprite + (wide ? 2 * first : first), rows - first, wide, x, quirks);
+            g->v[0xF][i] = (collide != 0);
+            pc += 2;
+            break;
+        }
+        case CHIP8_OP_SKP:
+            pc += ((g->keys[i] >> (g->v[d->x][i] & 0xF)) & 1) ? 4 : 2;
+            break;
+        case CHIP8_OP_SKNP:
+            pc += ((g->keys[i] >> (g->v[d->x][i] & 0xF)) & 1) ? 2 : 4;
+            break;
+        case CHIP8_OP_LD_VX_K:
+            if (!g->keys[i])
+            {
+                // keys only change between frames, wait out this one
+                g->left[i] = 0;
+                break;
+            }
+            for (g->v[d->x][i] = 0; !((g->keys[i] >> g->v[d->x][i]) & 1); g->v[d->x][i]++)
+                ;
+            pc += 2;
+            break;
+        case CHIP8_OP_LD_B_VX:
+        {
+            unsigned char num = g->v[d->x][i];
+            if (regI + 3 > MEM_SIZE)
+            {
+                laneFault(g, i);
+                return;
+            }
+            ram[regI] = num / 100;
+            ram[regI + 1] = (num / 10) % 10;
+            ram[regI + 2] = num % 10;
+            markWritten(g, regI, 3);
+            pc += 2;
+            break;
+        }
+        case CHIP8_OP_LD_MEM_VX:
+            if (regI + d->x + 1 > MEM_SIZE)
+            {
+                laneFault(g, i);
+                return;
+            }
+            for (int r = 0; r <= d->x; r++)
+                ram[regI + r] = g->v[r][i];
+            markWritten(g, regI, d->x + 1);
+            if (!(quirks & CHIP8_QUIRK_KEEP_I))
+                g->regI[i] += d->x + 1;
+            pc += 2;
+            break;
+        case CHIP8_OP_LD_VX_MEM:
+            if (regI + d->x + 1 > MEM_SIZE)
+            {
+                laneFault(g, i);
+                return;
+            }
+            for (int r = 0; r <= d->x; r++)
+                g->v[r][i] = ram[regI + r];
+            if (!(quirks & CHIP8_QUIRK_KEEP_I))
+                g->regI[i] += d->x + 1;
+            pc += 2;
+            break;
+        case CHIP8_OP_EXIT:
+            g->status[i] = CHIP8_HALT;
+            g->left[i] = 0;
+            break;
+        default:
+            // SUPER-CHIP and XO-CHIP display and flag instructions
+            g->status[i] = LOCKSTEP_UNSUPPORTED;
+            g->left[i] = 0;
+            break;
+    }
+    g->pc[i] = pc;
+}
+
+// run d on the masked lanes with loops over the whole group, 0 if it has no such form
+static int runMasked(const chip8_lockstep* ls, lockstep_group* g, const chip8_decoded* d, const unsigned char* m, const unsigned short* m16)
+{
+    unsigned int quirks = ls->quirks;
+    unsigned char* vx = g->v[d->x];
+    unsigned char* vy = g->v[d->y];
+    unsigned char* vf = g->v[0xF];
+    unsigned char nn = d->nnn & 0xFF;
+
+    switch (d->op)
+    {
+        case CHIP8_OP_LD_VX_NN:
+            LANES(vx[i] = BLEND8(vx[i], nn));
+            break;
+        case CHIP8_OP_ADD_VX_NN:
+            LANES(vx[i] += m[i] & nn);
+            break;
+        case CHIP8_OP_LD_VX_VY:
+            LANES(vx[i] = BLEND8(vx[i], vy[i]));
+            break;
+        case CHIP8_OP_OR:
+            LANES(vx[i] = BLEND8(vx[i], vx[i] | vy[i]));
+            if (quirks & CHIP8_QUIRK_VF_RESET)
+                LANES(vf[i] &= ~m[i]);
+            break;
+        case CHIP8_OP_AND:
+            LANES(vx[i] = BLEND8(vx[i], vx[i] & vy[i]));
+            if (quirks & CHIP8_QUIRK_VF_RESET)
+                LANES(vf[i] &= ~m[i]);
+            break;
+        case CHIP8_OP_XOR:
+            LANES(vx[i] = BLEND8(vx[i], vx[i] ^ vy[i]));
+            if (quirks & CHIP8_QUIRK_VF_RESET)
+                LANES(vf[i] &= ~m[i]);
+            break;
+        // flag and result are written in the order of ops.h, which matters when x or y is F
+        case CHIP8_OP_ADD_VX_VY:
+            LANES(unsigned int sum = vx[i] + vy[i]; vf[i] = BLEND8(vf[i], sum >> 8); vx[i] = BLEND8(vx[i], sum & 0xFF));
+            break;
+        case CHIP8_OP_SUB:
+            LANES(vf[i] = BLEND8(vf[i], vx[i] > vy[i]); vx[i] = BLEND8(vx[i], vx[i] - vy[i]));
+            break;
+        case CHIP8_OP_SUBN:
+            LANES(vf[i] = BLEND8(vf[i], vy[i] > vx[i]); vx[i] = BLEND8(vx[i], vy[i] - vx[i]));
+            break;
+        case CHIP8_OP_SHR:
+        {
+            const unsigned char* src = (quirks & CHIP8_QUIRK_SHIFT_VX) ? vx : vy;
+            LANES(unsigned char value = src[i]; vf[i] = BLEND8(vf[i], value & 1); vx[i] = BLEND8(vx[i], value >> 1));
+            break;
+        }
+        case CHIP8_OP_SHL:
+        {
+            const unsigned char* src = (quirks & CHIP8_QUIRK_SHIFT_VX) ? vx : vy;
+            LANES(unsigned char value = src[i]; vf[i] = BLEND8(vf[i], value >> 7); vx[i] = BLEND8(vx[i], value << 1));
+            break;
+        }
+        case CHIP8_OP_SE_VX_NN:
+            ADVANCE(vx[i] == nn ? 4 : 2);
+            return 1;
+        case CHIP8_OP_SNE_VX_NN:
+            ADVANCE(vx[i] != nn ? 4 : 2);
+            return 1;
+        case CHIP8_OP_SE_VX_VY:
+            ADVANCE(vx[i] == vy[i] ? 4 : 2);
+            return 1;
+        case CHIP8_OP_SNE_VX_VY:
+            ADVANCE(vx[i] != vy[i] ? 4 : 2);
+            return 1;
+        case CHIP8_OP_JP:
+            LANES(g->pc[i] = BLEND16(g->pc[i], d->nnn));
+            return 1;
+        case CHIP8_OP_LD_I:
+            LANES(g->regI[i] = BLEND16(g->regI[i], d->nnn));
+            break;
+        case CHIP8_OP_ADD_I_VX:
+            LANES(g->regI[i] += m16[i] & vx[i]);
+            break;
+        case CHIP8_OP_LD_F_VX:
+            LANES(g->regI[i] = BLEND16(g->regI[i], FONT_ADDR + vx[i] * 5));
+            break;
+        case CHIP8_OP_LD_VX_DT:
+            LANES(vx[i] = BLEND8(vx[i], g->delayTimer[i]));
+            break;
+        case CHIP8_OP_LD_DT_VX:
+            LANES(g->delayTimer[i] = BLEND8(g->delayTimer[i], vx[i]));
+            break;
+        case CHIP8_OP_LD_ST_VX:
+            LANES(g->soundTimer[i] = BLEND8(g->soundTimer[i], vx[i]));
+            break;
+        case CHIP8_OP_RND:
+            // the xorshift32 of opRandom on every lane
+            LANES(uint32_t r = g->rng[i]; uint32_t m32 = 0u - (m[i] & 1u);
+                r ^= r << 13; r ^= r >> 17; r ^= r << 5;
+                g->rng[i] = (g->rng[i] & ~m32) | (r & m32);
+                vx[i] = BLEND8(vx[i], (r >> 24) & nn));
+            break;
+        case CHIP8_OP_SYS:
+        case CHIP8_OP_INVALID:
+            break;
+        default:
+            return 0;
+    }
+    ADVANCE(2);
+    return 1;
+}
+
+// run one frame of every lane in the group
+static void stepGroup(chip8_lockstep* ls, int index)
+{
+    lockstep_group* g = &ls->groups[index];
+    int tickInsts = ls->tickInsts;
+    int running = 0;
+
+    LANES(g->left[i] = g->status[i] == CHIP8_OK ? tickInsts : 0);
+    LANES(running += g->status[i] == CHIP8_OK);
+
+    for (;;)
+    {
+        // lowest pc of the lanes still running: lanes that branched apart meet up
+        // again at the join point since the lanes behind catch up first
+        unsigned short pc = 0xFFFF;
+        LANES(unsigned short p = g->left[i] > 0 ? g->pc[i] : 0xFFFF; pc = p < pc ? p : pc);
+        if (pc == 0xFFFF)
+            break;
+        unsigned char m[W];
+        unsigned short m16[W];
+        LANES(m[i] = (g->left[i] > 0 && g->pc[i] == pc) ? 0xFF : 0);
+
+        if (pc >= ls->romEnd)
+        {
+            // off the end of the ROM
+            LANES(if (m[i]) { g->status[i] = CHIP8_HALT; g->left[i] = 0; });
+            continue;
+        }
+
+        chip8_decoded laneDecoded;
+        const chip8_decoded* d = &ls->decoded[pc];
+        uint64_t pages = (1ULL << (pc / CODE_PAGE)) | (1ULL << (((pc + 1) & (MEM_SIZE-1)) / CODE_PAGE));
+        if (g->writtenPages & pages)
+        {
+            // lanes may hold different code here: take the first lane's instruction and
+            // leave lanes holding another one for a later pass
+            int lead = 0;
+            while (!m[lead])
+                lead++;
+            unsigned short inst = fetch(g->ram[lead], pc);
+            LANES(if (m[i] && fetch(g->ram[i], pc) != inst) m[i] = 0);
+            chip8Decode(inst, &laneDecoded);
+            d = &laneDecoded;
+        }
+        LANES(m16[i] = m[i] ? 0xFFFF : 0);
+
+        int lanes = 0;
+        LANES(lanes += m[i] & 1; g->left[i] -= m[i] & 1);
+        g->stats.groupSteps++;
+        g->stats.insts += lanes;
+        if (runMasked(ls, g, d, m, m16))
+            g->stats.vectorLanes += lanes;
+        else
+        {
+            for (int i = 0; i < W; i++)
+            {
+                if (m[i])
+                    runLane(ls, g, i, d);
+            }
+            // a lone jump to itself spins to the end of the frame with nothing changing
+        }
+        if (d->op == CHIP8_OP_JP && d->nnn == pc)
+            LANES(g->left[i] &= ~(int)(signed char) m[i]);
+    }
+
+    // 60Hz timer tick of the lanes that ran the whole frame
+    LANES(unsigned char live = g->status[i] == CHIP8_OK;
+        g->delayTimer[i] -= live && g->delayTimer[i] > 0;
+        g->soundTimer[i] -= live && g->soundTimer[i] > 0);
+    g->stats.frames += running;
+}
+
+// step groups handed out one at a time until every group of the step has been claimed
+static void claimGroups(chip8_lockstep* ls)
+{
+    int gi;
+    while ((gi = __atomic_fetch_add(&ls->nextGroup, 1, __ATOMIC_RELAXED)) < ls->groupCount)
+        stepGroup(ls, gi);
+}
+
+static void* workerMain(void* arg)
+{
+    chip8_lockstep* ls = arg;
+    unsigned int seen = 0;
+    for (;;)
+    {
+        // frames are short, so poll for the next step a while before sleeping on it
+        int spin = 0;
+        while (__atomic_load_n(&ls->steps, __ATOMIC_ACQUIRE) == seen && spin < LOCKSTEP_SPIN)
+            spin++;
+        pthread_mutex_lock(&ls->lock);
+        while (ls->steps == seen && !ls->closing)
+            pthread_cond_wait(&ls->posted, &ls->lock);
+        int closing = ls->closing;
+        seen = ls->steps;
+        pthread_mutex_unlock(&ls->lock);
+        if (closing)
+            return NULL;
+
+        claimGroups(ls);
+        if (__atomic_sub_fetch(&ls->busy, 1, __ATOMIC_ACQ_REL) == 0)
+        {
+            pthread_mutex_lock(&ls->lock);
+            pthread_cond_signal(&ls->finished);
+            pthread_mutex_unlock(&ls->lock);
+        }
+    }
+}
+
+// start the workers, fewer or none if threads cannot be created, when the steps then run on
+// the calling thread alone
+static void startWorkers(chip8_lockstep* ls)
+{
+    int want = (ls->threads < ls->groupCount ? ls->threads : ls->groupCount) - 1;
+    if (want <= 0 || (ls->tids = calloc(want, sizeof(pthread_t))) == NULL)
+        return;
+    pthread_mutex_init(&ls->lock, NULL);
+    pthread_cond_init(&ls->posted, NULL);
+    pthread_cond_init(&ls->finished, NULL);
+    while (ls->workers < want && pthread_create(&ls->tids[ls->workers], NULL, workerMain, ls) == 0)
+        ls->workers++;
+}
+
+void lockstepStep(chip8_lockstep* ls, int tickInsts)
+{
+    ls->tickInsts = tickInsts;
+    if (ls->workers == 0)
+    {
+        for (int gi = 0; gi < ls->groupCount; gi++)
+            stepGroup(ls, gi);
+        return;
+    }
+
+    ls->nextGroup = 0;
+    ls->busy = ls->workers;
+    pthread_mutex_lock(&ls->lock);
+    __atomic_store_n(&ls->steps, ls->steps + 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&ls->posted);
+    pthread_mutex_unlock(&ls->lock);
+
+    claimGroups(ls);
+    int spin = 0;
+    while (__atomic_load_n(&ls->busy, __ATOMIC_ACQUIRE) && spin < LOCKSTEP_SPIN)
+        spin++;
+    pthread_mutex_lock(&ls->lock);
+    while (__atomic_load_n(&ls->busy, __ATOMIC_ACQUIRE))
+        pthread_cond_wait(&ls->finished, &ls->lock);
+    pthread_mutex_unlock(&ls->lock);
+}
+
+void lockstepObserve(const chip8_lockstep* ls, uint64_t* display, unsigned char* status)
+{
+    for (int lane = 0; lane < ls->lanes; lane++)
+    {
+        const lockstep_group* g = &ls->groups[lane / W];
+        if (display)
+            memcpy(display + (size_t) lane * DISPLAY_H, g->display[lane % W], DISPLAY_H * sizeof(uint64_t));
+        if (status)
+            status[lane] = g->status[lane % W];
+    }
+}
+
+void lockstepExport(const chip8_lockstep* ls, int lane, chip8_state* out)
+{
+    const lockstep_group* g = &ls->groups[lane / W];
+    int i = lane % W;
+    chip8Init(out, NULL);
+    chip8SetQuirks(out, ls->quirks);
+    memcpy(out->ram, g->ram[i], MEM_SIZE);
+    out->romSize = ls->romSize;
+    for (int r = 0; r < 16; r++)
+    {
+        out->regXY[r] = g->v[r][i];
+        out->stack[r] = g->stack[r][i];
+    }
+    out->pc = g->pc[i];
+    out->regI = g->regI[i];
+    out->delayTimer = g->delayTimer[i];
+    out->soundTimer = g->soundTimer[i];
+    out->stackPointer = g->sp[i];
+    out->keys = g->keys[i];
+    out->rng = g->rng[i];
+    memcpy(out->display[0][0], g->display[i], sizeof(g->display[i]));
+    out->drawFlag = 1;
+}
+
+void lockstepStats(const chip8_lockstep* ls, lockstep_stats* out)
+{
+    // summed from the groups, which each thread updates on its own
+    memset(out, 0, sizeof(*out));
+    for (int gi = 0; gi < ls->groupCount; gi++)
+    {
+        const lockstep_stats* s = &ls->groups[gi].stats;
+        out->frames += s->frames;
+        out->insts += s->insts;
+        out->groupSteps += s->groupSteps;
+        out->vectorLanes += s->vectorLanes;
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <stdint.h>
+
+#include "chip8.h"
+
+// many machines running the same ROM, stepped a frame at a time for agents and search.
+// machines (lanes) are grouped LOCKSTEP_WIDTH at a time with their registers, pc, I,
+// timers and stacks stored as arrays over the group's lanes. each step runs the
+// instruction at the lowest pc of the group for every lane at that pc, so lanes that
+// stay together share one decode and ALU, LD, skip and jump instructions run as loops
+// over all lanes with a mask. other instructions, and lanes that went elsewhere, run one
+// lane at a time. each step hands the groups out to the engine's threads, started once
+// with it and parked between steps.
+//
+// lanes run the original 64x32 CHIP-8 instruction set under any quirks profile, a lane
+// reaching a SUPER-CHIP or XO-CHIP instruction stops with LOCKSTEP_UNSUPPORTED.
+
+#define LOCKSTEP_WIDTH 32 // lanes per group
+
+// lane status beyond CHIP8_OK, CHIP8_HALT and CHIP8_FAULT
+#define LOCKSTEP_UNSUPPORTED 3
+
+typedef struct chip8_lockstep chip8_lockstep;
+
+typedef struct lockstep_stats
+{
+    long long frames; // lane frames run
+    long long insts; // lane instructions run
+    long long groupSteps; // instructions issued for a set of lanes at one pc
+    long long vectorLanes; // lane instructions run by the masked loops
+} lockstep_stats;
+
+// lanes machines running the romSize byte rom under a CHIP8_QUIRKS_* profile, all reset
+// with lockstepReset(ls, NULL, CHIP8_DEFAULT_SEED), stepped on threads threads including
+// the caller's (at most one per group). NULL if it cannot be allocated
+chip8_lockstep* lockstepCreate(int lanes, const unsigned char* rom, long romSize, unsigned int quirks, int threads);
+void lockstepDestroy(chip8_lockstep* ls);
+int lockstepLanes(const chip8_lockstep* ls);
+// reset the lanes with a nonzero mask entry, or every lane for NULL, to power on with the
+// ROM loaded. lane i seeds RND with seed + i
+void lockstepReset(chip8_lockstep* ls, const unsigned char* mask, uint32_t seed);
+// held key bitmap of every lane, used from the next step on
+void lockstepSetKeys(chip8_lockstep* ls, const uint16_t* keys);
+// run one frame on every lane: tickInsts instructions, then a timer tick
+void lockstepStep(chip8_lockstep* ls, int tickInsts);
+// copy out the framebuffers, DISPLAY_H packed rows per lane as in chip8_state, and the
+// lane statuses. either may be NULL
+void lockstepObserve(const chip8_lockstep* ls, uint64_t* display, unsigned char* status);
+// copy lane into a regular machine, for inspection or to continue it on its own
+void lockstepExport(const chip8_lockstep* ls, int lane, chip8_state* out);
+// totals over all lanes so far
+void lockstepStats(const chip8_lockstep* ls, lockstep_stats* out);
+
+#endif
@@ -0,0 +1,327 @@
+#ifndef OPS_H
+#define OPS_H
+
+// instruction semantics shared by the interpreter and the block translator. quirks is
+// always a compile-time constant at the call site, so each caller keeps only its variant
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+
+// sprite row i left aligned in a word: 8 pixels, or 16 for the 16x16 sprites of DXY0
+static inline uint64_t spriteRow(const unsigned char* sprite, int i, int wide)
+{
+    if (wide)
+        return ((uint64_t) sprite[2*i] << 56) | ((uint64_t) sprite[2*i+1] << 48);
+    return (uint64_t) sprite[i] << 56;
+}
+
+// XOR count sprite rows into consecutive 64 column rows at column x, wrapping horizontally
+// or clipping at the right edge, and return the AND of old and new pixels so any set bit
+// means a collision
+static inline uint64_t blitRows(uint64_t* rows, const unsigned char* sprite, int count, int wide, unsigned char x, const unsigned int quirks)
+{
+    uint64_t collide = 0;
+    for (int i = 0; i < count; i++)
+    {
+        uint64_t row = spriteRow(sprite, i, wide);
+        // rotate right by x so bits past column 63 come back in at column 0
+        if (quirks & CHIP8_QUIRK_WRAP)
+            row = (row >> x) | (row << ((64 - x) & 63));
+        else
+            row >>= x;
+        collide |= rows[i] & row;
+        rows[i] ^= row;
+    }
+    return collide;
+}
+
+// same for 128 column rows split over the word columns left and right
+static inline uint64_t blitRowsWide(uint64_t* left, uint64_t* right, const unsigned char* sprite, int count, int wide, unsigned char x, const unsigned int quirks)
+{
+    uint64_t collide = 0;
+    for (int i = 0; i < count; i++)
+    {
+        uint64_t row = spriteRow(sprite, i, wide);
+        uint64_t l, r;
+        if (x < 64)
+        {
+            // a sprite is at most 16 wide so it can spill into the right word but not past it
+            l = row >> x;
+            r = x ? row << (64 - x) : 0;
+        }
+        else
+        {
+            r = row >> (x - 64);
+            l = ((quirks & CHIP8_QUIRK_WRAP) && x > 64) ? row << (128 - x) : 0;
+        }
+        collide |= (left[i] & l) | (right[i] & r);
+        left[i] ^= l;
+        right[i] ^= r;
+    }
+    return collide;
+}
+
+// 00E0 CLS, of the selected planes
+static inline void opClear(chip8_state* state)
+{
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++)
+    {
+        if (state->planes & (1 << plane))
+            memset(state->display[plane], 0, sizeof(state->display[plane]));
+    }
+    state->drawFlag = 1;
+}
+
+// 00FE LOW and 00FF HIGH, switching modes clears every plane
+static inline void opResolution(chip8_state* state, int hires)
+{
+    state->hires = hires;
+    memset(state->display, 0, sizeof(state->display));
+    state->drawFlag = 1;
+}
+
+// 00CN SCD n and 00DN SCU n: move the selected planes down (n > 0) or up by whole rows,
+// one memmove per word column
+static inline void opScrollRows(chip8_state* state, int n)
+{
+    int height = chip8DisplayHeight(state);
+    int words = state->hires ? DISPLAY_WORDS : 1;
+    int shift = n < 0 ? -n : n;
+    if (shift > height)
+        shift = height;
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++)
+    {
+        if (!(state->planes & (1 << plane)))
+            continue;
+        for (int w = 0; w < words; w++)
+        {
+            uint64_t* rows = state->display[plane][w];
+            if (n > 0)
+            {
+                memmove(rows + shift, rows, (height - shift) * sizeof(uint64_t));
+                memset(rows, 0, shift * sizeof(uint64_t));
+            }
+            else
+            {
+                memmove(rows, rows + shift, (height - shift) * sizeof(uint64_t));
+                memset(rows + height - shift, 0, shift * sizeof(uint64_t));
+            }
+        }
+    }
+    state->drawFlag = 1;
+}
+
+// 00FB SCR and 00FC SCL: move the selected planes 4 pixels right or left. every row is
+// the same shift with no data dependence between rows, which the compiler can vectorize
+static inline void opScrollColumns(chip8_state* state, int right)
+{
+    int height = chip8DisplayHeight(state);
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++)
+    {
+        if (!(state->planes & (1 << plane)))
+            continue;
+        uint64_t* l = state->display[plane][0];
+        uint64_t* r = state->display[plane][1];
+        if (!state->hires)
+        {
+            for (int row = 0; row < height; row++)
+                l[row] = right ? l[row] >> 4 : l[row] << 4;
+        }
+        else if (right)
+        {
+            for (int row = 0; row < height; row++)
+            {
+                r[row] = (r[row] >> 4) | (l[row] << 60);
+                l[row] >>= 4;
+            }
+        }
+        else
+        {
+            for (int row = 0; row < height; row++)
+            {
+                l[row] = (l[row] << 4) | (r[row] >> 60);
+                r[row] <<= 4;
+            }
+        }
+    }
+    state->drawFlag = 1;
+}
+
+// after 8XY1 OR, 8XY2 AND, 8XY3 XOR
+static inline void opLogicFlag(unsigned char* regXY, const unsigned int quirks)
+{
+    if (quirks & CHIP8_QUIRK_VF_RESET)
+        regXY[0xF] = 0;
+}
+
+// 8XY4 ADD Vx, Vy
+static inline void opAddReg(unsigned char* regXY, int x, int y)
+{
+    unsigned short temp = (unsigned short) regXY[x] + (unsigned short) regXY[y];
+    // check carry
+    regXY[0xF] = ((temp >> 8) > 0);
+    regXY[x] = (unsigned char) (temp & 0xFF);
+}
+
+// 8XY5 SUB Vx, Vy
+static inline void opSub(unsigned char* regXY, int x, int y)
+{
+    regXY[0xF] = (regXY[x] > regXY[y]);
+    regXY[x] -= regXY[y];
+}
+
+// 8XY6 SHR Vx {, Vy}
+static inline void opShr(unsigned char* regXY, int x, int y, const unsigned int quirks)
+{
+    unsigned char value = (quirks & CHIP8_QUIRK_SHIFT_VX) ? regXY[x] : regXY[y];
+    // check carry
+    regXY[0xF] = value & 0x01;
+    regXY[x] = value >> 1;
+}
+
+// 8XY7 SUBN Vx, Vy
+static inline void opSubn(unsigned char* regXY, int x, int y)
+{
+    regXY[0xF] = (regXY[y] > regXY[x]);
+    regXY[x] = regXY[y] - regXY[x];
+}
+
+// 8XYE SHL Vx {, Vy}
+static inline void opShl(unsigned char* regXY, int x, int y, const unsigned int quirks)
+{
+    unsigned char value = (quirks & CHIP8_QUIRK_SHIFT_VX) ? regXY[x] : regXY[y];
+    // check carry
+    regXY[0xF] = (value & 0x80) >> 7;
+    regXY[x] = value << 1;
+}
+
+// CXNN RND Vx, nn
+static inline void opRandom(chip8_state* state, int x, unsigned char nn)
+{
+    // xorshift32, top byte since the low bits are the weakest
+    uint32_t r = state->rng;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    state->rng = r;
+    state->regXY[x] = (unsigned char)(r >> 24) & nn;
+}
+
+// sprite rows from y down, then the rest wrapped to the top (rest is 0 when clipping),
+// in each selected plane, each plane taking the next count row sprite from I
+static inline uint64_t drawPlanes(chip8_state* state, const unsigned char* sprite, int wide, int count, unsigned char x, unsigned char y, int first, int rest, const unsigned int quirks)
+{
+    uint64_t collide = 0;
+    int skip = wide ? 2 * first : first;
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++)
+    {
+        if (!(state->planes & (1 << plane)))
+            continue;
+        uint64_t* l = state->display[plane][0];
+        uint64_t* r = state->display[plane][1];
+        if (state->hires)
+        {
+            collide |= blitRowsWide(&l[y], &r[y], sprite, first, wide, x, quirks);
+            collide |= blitRowsWide(l, r, sprite + skip, rest, wide, x, quirks);
+        }
+        else
+        {
+            collide |= blitRows(&l[y], sprite, first, wide, x, quirks);
+            collide |= blitRows(l, sprite + skip, rest, wide, x, quirks);
+        }
+        // clipped rows are still part of this plane's sprite
+        sprite += wide ? 2 * count : count;
+    }
+    return collide;
+}
+
+// bytes DXYN reads from I: one sprite per selected plane, 16x16 ones for n = 0
+static inline int spriteBytes(const chip8_state* state, int n)
+{
+    int planes = (state->planes & 1) + ((state->planes >> 1) & 1);
+    return planes * (n ? n : 32);
+}
+
+// nonzero if len bytes from I run past the end of ram. callers check before DXYN, FX33,
+// FX55 and FX65, which index ram from I unmasked
+static inline int memFault(const chip8_state* state, int len)
+{
+    return state->regI + len > MEM_SIZE;
+}
+
+// DXYN DRW Vx, Vy, n, or a 16x16 sprite for n = 0
+static inline void opDraw(chip8_state* state, int regX, int regY, int n, const unsigned int quirks)
+{
+    const unsigned char* sprite = &state->ram[state->regI];
+    uint64_t collide;
+    if (state->planes == 1 && !state->hires && n)
+    {
+        // plain CHIP-8, kept apart so the common case has no mode tests in its loops
+        unsigned char x = state->regXY[regX] % DISPLAY_W;
+        unsigned char y = state->regXY[regY] % DISPLAY_H;
+        uint64_t* rows = state->display[0][0];
+        // rows up to the bottom edge, then the rest wrapped to the top or dropped
+        int first = (y + n > DISPLAY_H) ? DISPLAY_H - y : n;
+        collide = blitRows(&rows[y], sprite, first, 0, x, quirks);
+        if (quirks & CHIP8_QUIRK_WRAP)
+            collide |= blitRows(rows, sprite + first, n - first, 0, x, quirks);
+    }
+    else
+    {
+        int height = chip8DisplayHeight(state);
+        unsigned char x = state->regXY[regX] & (chip8DisplayWidth(state) - 1);
+        unsigned char y = state->regXY[regY] & (height - 1);
+        int wide = (n == 0);
+        int count = wide ? 16 : n;
+        int first = (y + count > height) ? height - y : count;
+        int rest = (quirks & CHIP8_QUIRK_WRAP) ? count - first : 0;
+        collide = drawPlanes(state, sprite, wide, count, x, y, first, rest, quirks);
+    }
+    state->regXY[0xF] = (collide != 0);
+    state->drawFlag = 1;
+}
+
+// FX33 LD B, Vx
+static inline void opStoreBcd(chip8_state* state, int x)
+{
+    unsigned char* ram = state->ram;
+    unsigned char num = state->regXY[x];
+    unsigned short regI = state->regI;
+    // store 100s
+    unsigned char huns = num / 100;
+    ram[regI] = huns;
+    // store 10s
+    unsigned char tens = (num - (huns*100)) / 10;
+    ram[regI+1] = tens;
+    // store 1s
+    unsigned char ones = (num - ((huns*100)+(tens*10)));
+    ram[regI+2] = ones;
+    chip8InvalidateCode(state, regI, 3);
+}
+
+// FX55 LD [I], Vx
+static inline void opStore(chip8_state* state, int x, const unsigned int quirks)
+{
+    for (int i = 0; i <= x; i++)
+    {
+        state->ram[state->regI+i] = state->regXY[i];
+    }
+    chip8InvalidateCode(state, state->regI, x + 1);
+    if (!(quirks & CHIP8_QUIRK_KEEP_I))
+        state->regI += x + 1;
+}
+
+// FX65 LD Vx, [I]
+static inline void opLoad(chip8_state* state, int x, const unsigned int quirks)
+{
+    for (int i = 0; i <= x; i++)
+    {
+        state->regXY[i] = state->ram[state->regI+i];
+    }
+    if (!(quirks & CHIP8_QUIRK_KEEP_I))
+        state->regI += x + 1;
+}
+
+#endif
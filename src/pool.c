@@ -0,0 +1,152 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+// per thread range of task indices [head, tail), owner takes from head, thieves from tail
+typedef struct pool_queue
+{
+    pthread_mutex_t lock;
+    int head;
+    int tail;
+} pool_queue;
+
+typedef struct pool_ctx
+{
+    pool_queue* queues;
+    int threads;
+    pool_task_fn fn;
+    void* arg;
+} pool_ctx;
+
+typedef struct pool_worker
+{
+    pool_ctx* ctx;
+    int id;
+} pool_worker;
+
+static int popOwn(pool_queue* q)
+{
+    int index = -1;
+    pthread_mutex_lock(&q->lock);
+    if (q->head < q->tail)
+        index = q->head++;
+    pthread_mutex_unlock(&q->lock);
+    return index;
+}
+
+// move the back half of the fullest other queue into ours, returns 0 when nothing is left
+static int steal(pool_ctx* ctx, int id)
+{
+    int victim = -1;
+    int best = 0;
+    for (int i = 0; i < ctx->threads; i++)
+    {
+        if (i == id)
+            continue;
+        pthread_mutex_lock(&ctx->queues[i].lock);
+        int left = ctx->queues[i].tail - ctx->queues[i].head;
+        pthread_mutex_unlock(&ctx->queues[i].lock);
+        if (left > best)
+        {
+            best = left;
+            victim = i;
+        }
+    }
+    if (victim < 0)
+        return 0;
+
+    pool_queue* from = &ctx->queues[victim];
+    pool_queue* to = &ctx->queues[id];
+    int head = 0, tail = 0;
+    pthread_mutex_lock(&from->lock);
+    int left = from->tail - from->head;
+    if (left > 0)
+    {
+        int take = (left + 1) / 2;
+        tail = from->tail;
+        head = tail - take;
+        from->tail = head;
+    }
+    pthread_mutex_unlock(&from->lock);
+
+    pthread_mutex_lock(&to->lock);
+    to->head = head;
+    to->tail = tail;
+    pthread_mutex_unlock(&to->lock);
+    return 1;
+}
+
+static void* workerMain(void* p)
+{
+    pool_worker* worker = p;
+    pool_ctx* ctx = worker->ctx;
+    for (;;)
+    {
+        int index = popOwn(&ctx->queues[worker->id]);
+        if (index >= 0)
+            ctx->fn(ctx->arg, index);
+        else if (!steal(ctx, worker->id))
+            break;
+    }
+    return NULL;
+}
+
+void poolRun(int threads, int count, pool_task_fn fn, void* arg)
+{
+    if (threads < 1)
+        threads = 1;
+    if (threads > count)
+        threads = count > 0 ? count : 1;
+
+    pool_ctx ctx;
+    ctx.queues = calloc(threads, sizeof(pool_queue));
+    ctx.threads = threads;
+    ctx.fn = fn;
+    ctx.arg = arg;
+    pool_worker* workers = calloc(threads, sizeof(pool_worker));
+    pthread_t* tids = calloc(threads, sizeof(pthread_t));
+    if (ctx.queues == NULL || workers == NULL || tids == NULL)
+    {
+        // no room for the queues: run everything on the calling thread
+        free(tids);
+        free(workers);
+        free(ctx.queues);
+        for (int i = 0; i < count; i++)
+            fn(arg, i);
+        return;
+    }
+
+    // even contiguous shares to start with
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_mutex_init(&ctx.queues[i].lock, NULL);
+        ctx.queues[i].head = (int)((long long)count * i / threads);
+        ctx.queues[i].tail = (int)((long long)count * (i+1) / threads);
+        workers[i].ctx = &ctx;
+        workers[i].id = i;
+    }
+
+    // the calling thread works as worker 0. the shares of threads that cannot be started
+    // are stolen by those that were
+    int started = 1;
+    while (started < threads && pthread_create(&tids[started], NULL, workerMain, &workers[started]) == 0)
+        started++;
+    workerMain(&workers[0]);
+    for (int i = 1; i < started; i++)
+        pthread_join(tids[i], NULL);
+
+    for (int i = 0; i < threads; i++)
+        pthread_mutex_destroy(&ctx.queues[i].lock);
+    free(tids);
+    free(workers);
+    free(ctx.queues);
+}
+
+int poolDefaultThreads(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
@@ -0,0 +1,16 @@
+#ifndef POOL_H
+#define POOL_H
+
+// called once per task index on one of the pool threads
+typedef void (*pool_task_fn)(void* arg, int index);
+
+// run fn(arg, i) for every i in [0, count) on the given number of threads and wait for
+// all of them. each thread starts on its own contiguous share of the indices and steals
+// half of the largest remaining share once its own runs out. if the queues cannot be
+// allocated every task runs on the calling thread.
+void poolRun(int threads, int count, pool_task_fn fn, void* arg);
+
+// number of online cores
+int poolDefaultThreads(void);
+
+#endif
@@ -0,0 +1,110 @@
+#include <stdlib.h>
+
+#include "chip8.h"
+#include "profile.h"
+
+#define PROFILE_OP_NAME(name) #name,
+static const char* const opNames[CHIP8_OP_COUNT] = { CHIP8_OPS(PROFILE_OP_NAME) };
+
+chip8_profile* profileCreate(void)
+{
+    chip8_profile* profile = calloc(1, sizeof(chip8_profile));
+    if (profile == NULL)
+        return NULL;
+    profile->nodes[0].addr = START_ADDR;
+    profile->nodes[0].parent = -1;
+    profile->nodes[0].child = -1;
+    profile->nodes[0].sibling = -1;
+    profile->nodeCount = 1;
+    return profile;
+}
+
+void profileDestroy(chip8_profile* profile)
+{
+    free(profile);
+}
+
+void profileCall(chip8_profile* profile, unsigned short addr)
+{
+    profile_node* cur = &profile->nodes[profile->node];
+    int i;
+    for (i = cur->child; i >= 0; i = profile->nodes[i].sibling)
+    {
+        if (profile->nodes[i].addr == addr)
+            break;
+    }
+    if (i < 0)
+    {
+        // out of nodes: stay on the caller's path until the matching return
+        if (profile->nodeCount == PROFILE_NODES)
+        {
+            profile->untracked++;
+            return;
+        }
+        i = profile->nodeCount++;
+        profile->nodes[i].addr = addr;
+        profile->nodes[i].parent = profile->node;
+        profile->nodes[i].child = -1;
+        profile->nodes[i].sibling = cur->child;
+        profile->nodes[i].insts = 0;
+        cur->child = i;
+    }
+    profile->node = i;
+}
+
+void profileReturn(chip8_profile* profile)
+{
+    if (profile->untracked > 0)
+        profile->untracked--;
+    else if (profile->nodes[profile->node].parent >= 0)
+        profile->node = profile->nodes[profile->node].parent;
+}
+
+void profileWriteJson(const chip8_profile* profile, FILE* out)
+{
+    const char* sep = "";
+    fprintf(out, "{\n  \"ops\": {");
+    for (int op = 0; op < CHIP8_OP_COUNT; op++)
+    {
+        if (profile->ops[op] == 0)
+            continue;
+        fprintf(out, "%s\n    \"%s\": %lld", sep, opNames[op], profile->ops[op]);
+        sep = ",";
+    }
+    fprintf(out, "\n  },\n  \"pcs\": {");
+    sep = "";
+    for (int pc = 0; pc < MEM_SIZE; pc++)
+    {
+        if (profile->pcs[pc] == 0)
+            continue;
+        fprintf(out, "%s\n    \"0x%03x\": %lld", sep, pc, profile->pcs[pc]);
+        sep = ",";
+    }
+    fprintf(out, "\n  },\n  \"calls\": {\n    \"maxDepth\": %d,\n    \"paths\": %d,\n    \"instsByDepth\": [", profile->maxDepth, profile->nodeCount);
+    for (int depth = 0; depth <= profile->maxDepth; depth++)
+        fprintf(out, "%s%lld", depth ? ", " : "", profile->depthInsts[depth]);
+    fprintf(out, "]\n  },\n  \"draw\": {\n    \"calls\": %lld,\n    \"rows\": %lld,\n    \"pixels\": %lld\n  }\n}\n",
+        profile->draws, profile->drawRows, profile->drawPixels);
+}
+
+static void writePath(const chip8_profile* profile, int node, FILE* out)
+{
+    if (profile->nodes[node].parent >= 0)
+    {
+        writePath(profile, profile->nodes[node].parent, out);
+        fprintf(out, ";0x%03x", profile->nodes[node].addr);
+    }
+    else
+        fprintf(out, "rom");
+}
+
+void profileWriteFolded(const chip8_profile* profile, FILE* out)
+{
+    for (int node = 0; node < profile->nodeCount; node++)
+    {
+        if (profile->nodes[node].insts == 0)
+            continue;
+        writePath(profile, node, out);
+        fprintf(out, " %lld\n", profile->nodes[node].insts);
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+
+#include "chip8.h"
+#include "ops.h"
+
+// execution profile of one machine, filled in by the interpreter when it is built with
+// -DCHIP8_PROFILE and state->profile is set. without the define the hooks compile to
+// nothing. instructions skipped by the wait loop fast-forward are not counted.
+
+#define PROFILE_NODES 4096 // distinct call paths tracked, calls past that count to their caller
+
+// one call path: the chain of CALL targets from the ROM entry
+typedef struct profile_node
+{
+    unsigned short addr;
+    int parent;
+    int child; // first child
+    int sibling;
+    long long insts; // instructions run with this path on top
+} profile_node;
+
+typedef struct chip8_profile
+{
+    long long ops[CHIP8_OP_COUNT]; // handler executions, DECODE counts cache fills
+    long long pcs[MEM_SIZE];
+    long long depthInsts[17]; // instructions run at each call depth, the stack pointer
+    int maxDepth;
+    long long draws;
+    long long drawRows; // sprite bytes blitted
+    long long drawPixels; // set sprite pixels blitted
+    int nodeCount;
+    int node; // current call path
+    int untracked; // calls made with every node in use, they stay on the caller's path
+    profile_node nodes[PROFILE_NODES];
+} chip8_profile;
+
+// zeroed profile with the root path at the ROM entry, NULL if it cannot be allocated
+chip8_profile* profileCreate(void);
+void profileDestroy(chip8_profile* profile);
+void profileCall(chip8_profile* profile, unsigned short addr);
+void profileReturn(chip8_profile* profile);
+// op and pc counts, call depths and draw work as JSON
+void profileWriteJson(const chip8_profile* profile, FILE* out);
+// one "rom;0x2a0;0x31c count" line per call path, the input format of flamegraph.pl
+void profileWriteFolded(const chip8_profile* profile, FILE* out);
+
+static inline void profileStep(chip8_profile* profile, unsigned short pc, int depth)
+{
+    profile->pcs[pc]++;
+    profile->depthInsts[depth]++;
+    if (depth > profile->maxDepth)
+        profile->maxDepth = depth;
+    profile->nodes[profile->node].insts++;
+}
+
+// bytes is the sprite data DXYN reads for every selected plane, see spriteBytes
+static inline void profileDraw(chip8_profile* profile, const unsigned char* sprite, int bytes)
+{
+    profile->draws++;
+    profile->drawRows += bytes;
+    for (int i = 0; i < bytes; i++)
+    {
+        for (unsigned char bits = sprite[i]; bits; bits &= bits - 1)
+            profile->drawPixels++;
+    }
+}
+
+// the hooks sample only what the interpreter's own fault checks let it touch: the call
+// depth while the stack pointer is in range and sprites that memFault lets DXYN read
+#ifdef CHIP8_PROFILE
+#define PROFILE_STEP(state, pc) do { if ((state)->profile && (state)->stackPointer <= 16) profileStep((state)->profile, pc, (state)->stackPointer); } while (0)
+#define PROFILE_OP(state, op) do { if ((state)->profile) (state)->profile->ops[op]++; } while (0)
+#define PROFILE_CALL(state, addr) do { if ((state)->profile) profileCall((state)->profile, addr); } while (0)
+#define PROFILE_RETURN(state) do { if ((state)->profile) profileReturn((state)->profile); } while (0)
+#define PROFILE_DRAW(state, n) do { if ((state)->profile && !memFault(state, spriteBytes(state, n))) \
+    profileDraw((state)->profile, &(state)->ram[(state)->regI], spriteBytes(state, n)); } while (0)
+#else
+#define PROFILE_STEP(state, pc)
+#define PROFILE_OP(state, op)
+#define PROFILE_CALL(state, addr)
+#define PROFILE_RETURN(state)
+#define PROFILE_DRAW(state, n)
+#endif
+
+#endif
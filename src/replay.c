@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "jit.h"
+#include "replay.h"
+
+// after the header the file is a list of records, each a tag byte and the varint
+// number of frames since the previous record, then the tag's payload. records apply at
+// the boundary before that frame runs, payloads are little endian
+enum replay_tag
+{
+    TAG_KEYS = 1, // uint16 key bitmap for this and later frames
+    TAG_CHECK = 2, // uint64 display hash after the frames so far
+    TAG_END = 3 // uint64 display hash at the end of the session
+};
+
+#define HEADER_SIZE 20
+
+typedef struct replay_record
+{
+    int tag;
+    long long at; // frame boundary it applies at
+    uint64_t payload;
+} replay_record;
+
+struct chip8_recorder
+{
+    FILE* out;
+    long long frame; // frames logged
+    long long lastAt; // boundary of the previous record
+    uint16_t keys;
+};
+
+struct chip8_replay
+{
+    unsigned char* data;
+    long size;
+    uint32_t seed;
+    int tickInsts;
+    unsigned int quirks;
+};
+
+static void putLe(FILE* out, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+        fputc((int)((value >> (8 * i)) & 0xFF), out);
+}
+
+static void putRecord(chip8_recorder* rec, int tag, uint64_t payload, int bytes)
+{
+    uint64_t delta = rec->frame - rec->lastAt;
+    fputc(tag, rec->out);
+    while (delta >= 0x80)
+    {
+        fputc((int)(delta | 0x80) & 0xFF, rec->out);
+        delta >>= 7;
+    }
+    fputc((int) delta, rec->out);
+    putLe(rec->out, payload, bytes);
+    rec->lastAt = rec->frame;
+}
+
+chip8_recorder* recordOpen(const char* path, uint32_t seed, int tickInsts, unsigned int quirks)
+{
+    FILE* out = fopen(path, "wb");
+    if (out == NULL)
+        return NULL;
+    chip8_recorder* rec = calloc(1, sizeof(chip8_recorder));
+    if (rec == NULL)
+    {
+        fclose(out);
+        return NULL;
+    }
+    rec->out = out;
+    fwrite(REPLAY_MAGIC, 1, 4, out);
+    putLe(out, REPLAY_VERSION, 4);
+    putLe(out, seed, 4);
+    putLe(out, (uint32_t) tickInsts, 4);
+    putLe(out, quirks, 4);
+    return rec;
+}
+
+void recordFrame(chip8_recorder* rec, uint16_t keys, const chip8_state* state)
+{
+    if (keys != rec->keys)
+    {
+        putRecord(rec, TAG_KEYS, keys, 2);
+        rec->keys = keys;
+    }
+    rec->frame++;
+    if (rec->frame % REPLAY_CHECK_FRAMES == 0)
+        putRecord(rec, TAG_CHECK, chip8DisplayHash(state), 8);
+}
+
+int recordClose(chip8_recorder* rec, const chip8_state* state)
+{
+    putRecord(rec, TAG_END, chip8DisplayHash(state), 8);
+    int status = (ferror(rec->out) || fclose(rec->out) != 0) ? -1 : 0;
+    free(rec);
+    return status;
+}
+
+static uint64_t getLe(const unsigned char* in, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+        value |= (uint64_t) in[i] << (8 * i);
+    return value;
+}
+
+chip8_replay* replayOpen(const char* path)
+{
+    FILE* in = fopen(path, "rb");
+    if (in == NULL)
+        return NULL;
+    chip8_replay* replay = calloc(1, sizeof(chip8_replay));
+    fseek(in, 0, SEEK_END);
+    long size = ftell(in);
+    rewind(in);
+    if (replay && size >= HEADER_SIZE && (replay->data = malloc(size)) != NULL && fread(replay->data, 1, size, in) == (size_t) size
+        && !memcmp(replay->data, REPLAY_MAGIC, 4) && getLe(replay->data + 4, 4) == REPLAY_VERSION
+        && (int) getLe(replay->data + 12, 4) > 0) // frames of no instructions would never end
+    {
+        replay->quirks = (unsigned int) getLe(replay->data + 16, 4);
+        fclose(in);
+        replay->size = size;
+        replay->seed = (uint32_t) getLe(replay->data + 8, 4);
+        replay->tickInsts = (int) getLe(replay->data + 12, 4);
+        if (replay->quirks == CHIP8_QUIRKS_CHIP8 || replay->quirks == CHIP8_QUIRKS_SCHIP || replay->quirks == CHIP8_QUIRKS_MODERN)
+            return replay;
+        replayClose(replay);
+        return NULL;
+    }
+    fclose(in);
+    replayClose(replay);
+    return NULL;
+}
+
+void replayClose(chip8_replay* replay)
+{
+    if (replay == NULL)
+        return;
+    free(replay->data);
+    free(replay);
+}
+
+uint32_t replaySeed(const chip8_replay* replay)
+{
+    return replay->seed;
+}
+
+int replayTickInsts(const chip8_replay* replay)
+{
+    return replay->tickInsts;
+}
+
+unsigned int replayQuirks(const chip8_replay* replay)
+{
+    return replay->quirks;
+}
+
+// read the record at *p whose delta counts from prevAt, 0 at the end of the data
+static int readRecord(const unsigned char** p, const unsigned char* end, long long prevAt, replay_record* r)
+{
+    const unsigned char* q = *p;
+    uint64_t delta = 0;
+    int shift = 0;
+    unsigned char c;
+    if (q >= end)
+        return 0;
+    r->tag = *q++;
+    do
+    {
+        if (q >= end)
+            return 0;
+        c = *q++;
+        delta |= (uint64_t)(c & 0x7F) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    int bytes = r->tag == TAG_KEYS ? 2 : 8;
+    if (end - q < bytes)
+        return 0;
+    r->payload = getLe(q, bytes);
+    r->at = prevAt + (long long) delta;
+    *p = q + bytes;
+    return 1;
+}
+
+int replayRun(chip8_replay* replay, chip8_state* state, chip8_jit* jit, replay_result* out)
+{
+    const unsigned char* p = replay->data + HEADER_SIZE;
+    const unsigned char* end = replay->data + replay->size;
+    long long frame = 0;
+    int status = CHIP8_OK;
+    replay_record r;
+
+    memset(out, 0, sizeof(*out));
+    out->firstMismatch = -1;
+    state->keys = 0;
+
+    int have = readRecord(&p, end, 0, &r);
+    while (have)
+    {
+        // apply every record at this boundary
+        while (have && r.at == frame)
+        {
+            if (r.tag == TAG_KEYS)
+                state->keys = (uint16_t) r.payload;
+            else
+            {
+                out->checkpoints++;
+                if (r.payload != chip8DisplayHash(state) && out->mismatches++ == 0)
+                    out->firstMismatch = frame;
+            }
+            have = r.tag != TAG_END && readRecord(&p, end, r.at, &r);
+        }
+        if (!have || status != CHIP8_OK)
+            break;
+
+        status = jit ? chip8JitRun(jit, state, replay->tickInsts) : chip8Run(state, replay->tickInsts);
+        if (status == CHIP8_OK)
+            chip8TickTimers(state);
+        frame++;
+    }
+    out->frames = frame;
+    return status;
+}
@@ -0,0 +1,48 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+
+#include "chip8.h"
+#include "jit.h"
+
+#define REPLAY_MAGIC "C8RP"
+#define REPLAY_VERSION 2 // 2 added the quirks profile
+#define REPLAY_CHECK_FRAMES 60 // frames between display hash checkpoints
+
+// input recording: the held key bitmap of every frame, stored only when it changes,
+// plus a display hash every REPLAY_CHECK_FRAMES frames and at the end. together with
+// the seed, instructions per frame and quirks profile this is enough to rerun a session
+// exactly.
+typedef struct chip8_recorder chip8_recorder;
+
+// start recording a session whose frames run tickInsts instructions from RND seed under
+// a CHIP8_QUIRKS_* profile
+chip8_recorder* recordOpen(const char* path, uint32_t seed, int tickInsts, unsigned int quirks);
+// log one frame that just ran with the given keys
+void recordFrame(chip8_recorder* rec, uint16_t keys, const chip8_state* state);
+// write the end marker with the final display hash and close, returns -1 on write errors
+int recordClose(chip8_recorder* rec, const chip8_state* state);
+
+typedef struct chip8_replay chip8_replay;
+
+typedef struct replay_result
+{
+    long long frames;
+    int checkpoints; // display hashes compared
+    int mismatches;
+    long long firstMismatch; // frame of the first mismatch, -1 if none
+} replay_result;
+
+// read a recording, NULL if it cannot be read, is not one, has no instructions per frame
+// or an unknown quirks profile
+chip8_replay* replayOpen(const char* path);
+void replayClose(chip8_replay* replay);
+uint32_t replaySeed(const chip8_replay* replay);
+int replayTickInsts(const chip8_replay* replay);
+unsigned int replayQuirks(const chip8_replay* replay);
+// rerun the recorded frames on state, which must hold the ROM or snapshot the session
+// started from, at full speed through jit if given. returns the last run status
+int replayRun(chip8_replay* replay, chip8_state* state, chip8_jit* jit, replay_result* out);
+
+#endif
@@ -0,0 +1,228 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "savestate.h"
+#include "rewind.h"
+
+#define FRAME_SIZE sizeof(chip8_savestate)
+
+// where a frame's encoding sits in the ring, and the frame its keyframe is
+typedef struct rewind_entry
+{
+    size_t off;
+    size_t len;
+    long long key; // sequence number of the keyframe, its own for a keyframe
+} rewind_entry;
+
+struct chip8_rewind
+{
+    unsigned char* buf;
+    size_t size;
+    rewind_entry* entries; // indexed by sequence number modulo cap
+    long long cap;
+    long long first; // oldest frame held
+    long long next; // sequence number of the next frame pushed
+    int keyInterval;
+    chip8_savestate key; // newest keyframe held, the reference for new frames
+    long long keySeq; // its sequence number, -1 if none
+    unsigned char* scratch; // one frame at worst case encoded size
+    chip8_rewind_stats stats;
+};
+
+static const chip8_savestate zeroFrame;
+
+static size_t putVarint(unsigned char* out, size_t value)
+{
+    size_t n = 0;
+    while (value >= 0x80)
+    {
+        out[n++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (unsigned char) value;
+    return n;
+}
+
+static size_t getVarint(const unsigned char** in)
+{
+    size_t value = 0;
+    int shift = 0;
+    unsigned char c;
+    do
+    {
+        c = *(*in)++;
+        value |= (size_t)(c & 0x7F) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    return value;
+}
+
+// cur XOR ref as alternating runs: unchanged byte count, changed byte count, changed bytes
+static size_t encode(const unsigned char* cur, const unsigned char* ref, unsigned char* out)
+{
+    size_t n = 0;
+    size_t i = 0;
+    while (i < FRAME_SIZE)
+    {
+        size_t z = i;
+        while (z < FRAME_SIZE && cur[z] == ref[z])
+            z++;
+        // a single unchanged byte costs less inside the literal run than as a new token
+        size_t l = z;
+        while (l < FRAME_SIZE && (cur[l] != ref[l] || (l + 1 < FRAME_SIZE && cur[l+1] != ref[l+1])))
+            l++;
+        n += putVarint(out + n, z - i);
+        n += putVarint(out + n, l - z);
+        for (size_t k = z; k < l; k++)
+            out[n++] = cur[k] ^ ref[k];
+        i = l;
+    }
+    return n;
+}
+
+// XOR an encoded frame into out
+static void apply(const unsigned char* in, unsigned char* out)
+{
+    size_t i = 0;
+    while (i < FRAME_SIZE)
+    {
+        i += getVarint(&in);
+        for (size_t l = getVarint(&in); l > 0; l--)
+            out[i++] ^= *in++;
+    }
+}
+
+static void evictOne(chip8_rewind* rw)
+{
+    rw->stats.bytes -= rw->entries[rw->first % rw->cap].len;
+    rw->first++;
+    rw->stats.evicted++;
+}
+
+// drop the oldest keyframe and every frame encoded against it
+static void evictGroup(chip8_rewind* rw)
+{
+    evictOne(rw);
+    while (rw->first < rw->next && rw->entries[rw->first % rw->cap].key != rw->first)
+        evictOne(rw);
+    if (rw->keySeq < rw->first)
+        rw->keySeq = -1;
+}
+
+// offset for len contiguous bytes, evicting the oldest frames until they fit
+static size_t reserve(chip8_rewind* rw, size_t len)
+{
+    for (;;)
+    {
+        if (rw->first == rw->next)
+            return 0;
+        if (rw->next - rw->first < rw->cap)
+        {
+            const rewind_entry* oldest = &rw->entries[rw->first % rw->cap];
+            const rewind_entry* newest = &rw->entries[(rw->next - 1) % rw->cap];
+            size_t end = newest->off + newest->len;
+            if (newest->off >= oldest->off)
+            {
+                // held frames are one span [oldest, end), try after it then before it
+                if (end + len <= rw->size)
+                    return end;
+                if (len <= oldest->off)
+                    return 0;
+            }
+            else if (end + len <= oldest->off)
+                return end;
+        }
+        evictGroup(rw);
+    }
+}
+
+chip8_rewind* rewindCreate(size_t budget, int keyInterval)
+{
+    chip8_rewind* rw = calloc(1, sizeof(chip8_rewind));
+    if (rw == NULL)
+        return NULL;
+    rw->size = budget;
+    rw->cap = budget / 32 + 2;
+    rw->keyInterval = keyInterval > 0 ? keyInterval : 1;
+    rw->keySeq = -1;
+    rw->buf = malloc(budget);
+    rw->entries = malloc(rw->cap * sizeof(rewind_entry));
+    rw->scratch = malloc(2 * FRAME_SIZE + 16);
+    if (rw->buf == NULL || rw->entries == NULL || rw->scratch == NULL)
+    {
+        rewindDestroy(rw);
+        return NULL;
+    }
+    return rw;
+}
+
+void rewindDestroy(chip8_rewind* rw)
+{
+    if (rw == NULL)
+        return;
+    free(rw->buf);
+    free(rw->entries);
+    free(rw->scratch);
+    free(rw);
+}
+
+void rewindPush(chip8_rewind* rw, const chip8_state* state)
+{
+    chip8_savestate cur;
+    saveCapture(state, &cur);
+
+    int isKey = rw->keySeq < 0 || rw->next - rw->keySeq >= rw->keyInterval;
+    size_t len = encode((const unsigned char*) &cur, (const unsigned char*)(isKey ? &zeroFrame : &rw->key), rw->scratch);
+    if (len > rw->size)
+        return;
+    size_t off = reserve(rw, len);
+    if (!isKey && rw->keySeq < 0)
+    {
+        // making room evicted the keyframe this frame was encoded against
+        isKey = 1;
+        len = encode((const unsigned char*) &cur, (const unsigned char*) &zeroFrame, rw->scratch);
+        if (len > rw->size)
+            return;
+        off = reserve(rw, len);
+    }
+
+    memcpy(rw->buf + off, rw->scratch, len);
+    rewind_entry* e = &rw->entries[rw->next % rw->cap];
+    e->off = off;
+    e->len = len;
+    e->key = isKey ? rw->next : rw->keySeq;
+    if (isKey)
+    {
+        rw->key = cur;
+        rw->keySeq = rw->next;
+    }
+    rw->next++;
+    rw->stats.bytes += len;
+    rw->stats.pushed++;
+}
+
+int rewindPop(chip8_rewind* rw, chip8_state* state)
+{
+    // the newest frame is the current state, go back to the one before it
+    if (rw->next - rw->first < 2)
+        return -1;
+    rw->next--;
+    rw->stats.bytes -= rw->entries[rw->next % rw->cap].len;
+
+    const rewind_entry* e = &rw->entries[(rw->next - 1) % rw->cap];
+    const rewind_entry* key = &rw->entries[e->key % rw->cap];
+    chip8_savestate frame = zeroFrame;
+    apply(rw->buf + key->off, (unsigned char*) &frame);
+    rw->key = frame;
+    rw->keySeq = e->key;
+    if (e != key)
+        apply(rw->buf + e->off, (unsigned char*) &frame);
+    return saveRestore(state, &frame);
+}
+
+void rewindStats(const chip8_rewind* rw, chip8_rewind_stats* out)
+{
+    *out = rw->stats;
+    out->frames = (int)(rw->next - rw->first);
+}
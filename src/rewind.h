@@ -0,0 +1,31 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <stddef.h>
+
+#include "chip8.h"
+
+// rewind buffer: one savestate per frame in a fixed size byte ring. every keyInterval
+// frames a keyframe is stored, other frames as the XOR against their keyframe, and both
+// run length encoded since most of ram and the display do not change. when the budget
+// runs out the oldest keyframe is dropped together with the frames that depend on it.
+typedef struct chip8_rewind chip8_rewind;
+
+typedef struct chip8_rewind_stats
+{
+    int frames; // frames held
+    size_t bytes; // encoded bytes held
+    long long pushed;
+    long long evicted;
+} chip8_rewind_stats;
+
+// budget is the size of the byte ring, NULL if it cannot be allocated
+chip8_rewind* rewindCreate(size_t budget, int keyInterval);
+void rewindDestroy(chip8_rewind* rw);
+// capture the state at the end of a frame
+void rewindPush(chip8_rewind* rw, const chip8_state* state);
+// restore the newest frame and drop it, returns -1 if nothing is left
+int rewindPop(chip8_rewind* rw, chip8_state* state);
+void rewindStats(const chip8_rewind* rw, chip8_rewind_stats* out);
+
+#endif
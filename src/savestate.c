@@ -0,0 +1,134 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "chip8.h"
+#include "savestate.h"
+
+void saveCapture(const chip8_state* state, chip8_savestate* out)
+{
+    memcpy(out->magic, SAVE_MAGIC, 4);
+    out->version = SAVE_VERSION;
+    out->size = sizeof(chip8_savestate);
+    out->rng = state->rng;
+    out->cycles = state->cycles;
+    out->romSize = state->romSize;
+    memcpy(out->display, state->display, sizeof(out->display));
+    memcpy(out->stack, state->stack, sizeof(out->stack));
+    out->stackPointer = state->stackPointer;
+    out->regI = state->regI;
+    out->pc = state->pc;
+    memcpy(out->regXY, state->regXY, sizeof(out->regXY));
+    out->delayTimer = state->delayTimer;
+    out->soundTimer = state->soundTimer;
+    out->quirks = state->quirks;
+    out->hires = state->hires;
+    out->planes = state->planes;
+    memcpy(out->flags, state->flags, sizeof(out->flags));
+    memcpy(out->ram, state->ram, sizeof(out->ram));
+}
+
+static int saveValid(const chip8_savestate* save)
+{
+    return !memcmp(save->magic, SAVE_MAGIC, 4) && save->version == SAVE_VERSION && save->size == sizeof(chip8_savestate);
+}
+
+// nonzero if the fields the interpreter indexes with are in range, so a damaged or
+// hand-edited snapshot cannot send it outside its arrays
+static int saveSane(const chip8_savestate* save)
+{
+    unsigned int quirks = save->quirks;
+    return save->stackPointer <= 16 && save->pc < MEM_SIZE
+        && save->romSize >= 0 && save->romSize <= MEM_SIZE - START_ADDR
+        && save->hires <= 1 && save->planes <= 3
+        && (quirks == CHIP8_QUIRKS_CHIP8 || quirks == CHIP8_QUIRKS_SCHIP || quirks == CHIP8_QUIRKS_MODERN);
+}
+
+int saveRestore(chip8_state* state, const chip8_savestate* save)
+{
+    if (!saveValid(save) || !saveSane(save))
+        return -1;
+    state->rng = save->rng;
+    state->cycles = save->cycles;
+    state->romSize = save->romSize;
+    memcpy(state->display, save->display, sizeof(state->display));
+    memcpy(state->stack, save->stack, sizeof(state->stack));
+    state->stackPointer = save->stackPointer;
+    state->regI = save->regI;
+    state->pc = save->pc;
+    memcpy(state->regXY, save->regXY, sizeof(state->regXY));
+    state->delayTimer = save->delayTimer;
+    state->soundTimer = save->soundTimer;
+    chip8SetQuirks(state, save->quirks);
+    state->hires = save->hires;
+    state->planes = save->planes;
+    memcpy(state->flags, save->flags, sizeof(state->flags));
+    memcpy(state->ram, save->ram, sizeof(state->ram));
+
+    // all of ram changed: drop every decoded instruction, CHIP8_OP_DECODE is 0, and
+    // every translated block
+    memset(state->decoded, 0, sizeof(state->decoded));
+    state->dirtyPages = state->codePages;
+    state->drawFlag = 1;
+    state->fault = 0;
+    return 0;
+}
+
+int saveWrite(const chip8_state* state, const char* path)
+{
+    chip8_savestate save;
+    saveCapture(state, &save);
+    FILE* out = fopen(path, "wb");
+    if (out == NULL)
+        return -1;
+    size_t written = fwrite(&save, sizeof(save), 1, out);
+    if (fclose(out) != 0 || written != 1)
+        return -1;
+    return 0;
+}
+
+const chip8_savestate* saveMap(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size == sizeof(chip8_savestate))
+        map = mmap(NULL, sizeof(chip8_savestate), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+    if (!saveValid(map))
+    {
+        munmap(map, sizeof(chip8_savestate));
+        return NULL;
+    }
+    return map;
+}
+
+void saveUnmap(const chip8_savestate* save)
+{
+    munmap((void*) save, sizeof(chip8_savestate));
+}
+
+int saveOpen(chip8_state* state, const char* path)
+{
+    const chip8_savestate* save = saveMap(path);
+    if (save)
+    {
+        int restored = saveRestore(state, save);
+        saveUnmap(save);
+        if (restored < 0)
+        {
+            printf("corrupt snapshot: %s\n", path);
+            return -1;
+        }
+        return 1;
+    }
+    return chip8LoadRom(state, path) < 0 ? -1 : 0;
+}
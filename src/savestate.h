@@ -0,0 +1,55 @@
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include <stdint.h>
+
+#include "chip8.h"
+
+#define SAVE_MAGIC "C8SV"
+#define SAVE_VERSION 3 // 2 added quirks, 3 hires mode, planes and flags
+
+// machine state as written to disk: fixed width fields in host byte order, laid out so a
+// mapped file can be restored from directly. a file from a host with the other byte
+// order or an older layout fails the version/size check instead of restoring garbage.
+typedef struct chip8_savestate
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t size; // sizeof(chip8_savestate)
+    uint32_t rng;
+    int64_t cycles;
+    int64_t romSize;
+    uint64_t display[DISPLAY_PLANES][DISPLAY_WORDS][DISPLAY_HIRES_H];
+    uint16_t stack[16];
+    uint16_t stackPointer;
+    uint16_t regI;
+    uint16_t pc;
+    uint8_t regXY[16];
+    uint8_t delayTimer;
+    uint8_t soundTimer;
+    uint8_t quirks;
+    uint8_t hires;
+    uint8_t planes;
+    uint8_t flags[16];
+    uint8_t ram[MEM_SIZE];
+} chip8_savestate;
+
+// copy the machine state into out
+void saveCapture(const chip8_state* state, chip8_savestate* out);
+// restore a captured state, keeping the front end. returns -1 and leaves state alone
+// if save is not a snapshot of this version or holds an out of range stack pointer, pc,
+// ROM size, display mode, plane mask or quirks profile
+int saveRestore(chip8_state* state, const chip8_savestate* save);
+
+// write a snapshot of state to path, returns -1 on failure
+int saveWrite(const chip8_state* state, const char* path);
+// map the snapshot at path read only, NULL if it cannot be read or is not a snapshot.
+// any number of workers can restore from one mapping
+const chip8_savestate* saveMap(const char* path);
+void saveUnmap(const chip8_savestate* save);
+
+// restore path into state if it is a snapshot, otherwise load it as a ROM. returns
+// 1 for a snapshot, 0 for a ROM and -1 if it cannot be read or the snapshot is corrupt
+int saveOpen(chip8_state* state, const char* path);
+
+#endif
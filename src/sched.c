@@ -0,0 +1,76 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "sched.h"
+
+static void addNs(struct timespec* t, long long ns)
+{
+    ns += t->tv_nsec;
+    t->tv_sec += ns / 1000000000LL;
+    t->tv_nsec = ns % 1000000000LL;
+}
+
+// a - b in ns
+static long long diffNs(const struct timespec* a, const struct timespec* b)
+{
+    return (a->tv_sec - b->tv_sec) * 1000000000LL + (a->tv_nsec - b->tv_nsec);
+}
+
+void schedInit(frame_sched* sched, int hz, int maxCatchUp)
+{
+    sched->periodNs = 1000000000LL / hz;
+    sched->maxCatchUp = maxCatchUp > 0 ? maxCatchUp : 1;
+    sched->frames = 0;
+    sched->dropped = 0;
+    sched->wakeups = 0;
+    sched->lateSum = 0;
+    sched->lateSqSum = 0;
+    sched->lateMax = 0;
+    clock_gettime(CLOCK_MONOTONIC, &sched->next);
+    addNs(&sched->next, sched->periodNs);
+}
+
+int schedWait(frame_sched* sched)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long late = diffNs(&now, &sched->next);
+    if (late < 0)
+    {
+        // sleep to the absolute deadline, restarting if a signal cuts it short
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &sched->next, NULL) == EINTR)
+            ;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        late = diffNs(&now, &sched->next);
+    }
+
+    sched->wakeups++;
+    sched->lateSum += late;
+    sched->lateSqSum += (double) late * late;
+    if (late > sched->lateMax)
+        sched->lateMax = late;
+
+    // this frame plus any whole periods missed since, the schedule stays anchored either way
+    long long due = 1 + late / sched->periodNs;
+    addNs(&sched->next, due * sched->periodNs);
+    if (due > sched->maxCatchUp)
+    {
+        sched->dropped += due - sched->maxCatchUp;
+        due = sched->maxCatchUp;
+    }
+    sched->frames += due;
+    return (int) due;
+}
+
+void schedPrint(const frame_sched* sched, FILE* out)
+{
+    if (sched->wakeups == 0)
+        return;
+    double mean = sched->lateSum / sched->wakeups;
+    double var = sched->lateSqSum / sched->wakeups - mean * mean;
+    fprintf(out, "frames: %lld (%lld dropped), wakeup jitter: mean %.1f us, stddev %.1f us, max %.1f us\n",
+        sched->frames, sched->dropped, mean / 1e3, var > 0 ? sqrt(var) / 1e3 : 0.0, sched->lateMax / 1e3);
+}
@@ -0,0 +1,33 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdio.h>
+#include <time.h>
+
+// fixed rate frame scheduler on CLOCK_MONOTONIC. deadlines are absolute so time spent
+// emulating, drawing and reading keys does not accumulate as drift. a caller that falls
+// behind runs the missed frames back to back, up to maxCatchUp, and the rest are dropped.
+typedef struct frame_sched
+{
+    struct timespec next; // deadline of the next frame
+    long long periodNs;
+    int maxCatchUp;
+
+    long long frames; // frames handed out, including catch-up
+    long long dropped;
+    long long wakeups;
+    double lateSum; // wakeup lateness past the deadline in ns, for mean and deviation
+    double lateSqSum;
+    double lateMax;
+} frame_sched;
+
+// first deadline one period from now
+void schedInit(frame_sched* sched, int hz, int maxCatchUp);
+
+// sleep until the next deadline and return how many frames are due, at least 1
+int schedWait(frame_sched* sched);
+
+// frame count, drops and wakeup jitter
+void schedPrint(const frame_sched* sched, FILE* out);
+
+#endif
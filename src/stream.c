@@ -0,0 +1,588 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "chip8.h"
+#include "stream.h"
+
+#define MAX_RECORD (2 * 10 + 1 + STREAM_ROWS * (2 * 10 + 3 * STREAM_ROW_BYTES)) // worst case encoding of one frame
+
+struct chip8_stream
+{
+    int fd;
+    int own;
+    int failed;
+    long long pending; // frames repeating the last one written
+    unsigned char mode;
+    uint64_t prev[DISPLAY_PLANES][DISPLAY_WORDS][DISPLAY_HIRES_H]; // display of the last frame written
+    unsigned char* buf;
+    size_t used;
+    int sinceFlush; // frames since the last write
+    stream_stats stats;
+};
+
+static size_t putVarint(unsigned char* out, unsigned long long value)
+{
+    size_t n = 0;
+    while (value >= 0x80)
+    {
+        out[n++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (unsigned char) value;
+    return n;
+}
+
+// the 16 bytes of row r in stream order
+static void rowBytes(const uint64_t display[DISPLAY_PLANES][DISPLAY_WORDS][DISPLAY_HIRES_H], int r, unsigned char* out)
+{
+    int plane = r / DISPLAY_HIRES_H;
+    int row = r % DISPLAY_HIRES_H;
+    for (int w = 0; w < DISPLAY_WORDS; w++)
+    {
+        for (int b = 0; b < 8; b++)
+            out[8 * w + b] = (unsigned char)(display[plane][w][row] >> (56 - 8 * b));
+    }
+}
+
+static int rowChanged(const chip8_stream* stream, const chip8_state* state, int r)
+{
+    int plane = r / DISPLAY_HIRES_H;
+    int row = r % DISPLAY_HIRES_H;
+    for (int w = 0; w < DISPLAY_WORDS; w++)
+    {
+        if (state->display[plane][w][row] != stream->prev[plane][w][row])
+            return 1;
+    }
+    return 0;
+}
+
+// cur XOR ref as alternating runs: zero byte count, literal byte count, literal bytes
+static size_t encodeRow(const unsigned char* cur, const unsigned char* ref, unsigned char* out)
+{
+    size_t n = 0;
+    int i = 0;
+    while (i < STREAM_ROW_BYTES)
+    {
+        int z = i;
+        while (z < STREAM_ROW_BYTES && cur[z] == ref[z])
+            z++;
+        // a single zero byte costs less inside the literal run than as a new token
+        int l = z;
+        while (l < STREAM_ROW_BYTES && (cur[l] != ref[l] || (l + 1 < STREAM_ROW_BYTES && cur[l+1] != ref[l+1])))
+            l++;
+        n += putVarint(out + n, z - i);
+        n += putVarint(out + n, l - z);
+        for (int k = z; k < l; k++)
+            out[n++] = cur[k] ^ ref[k];
+        i = l;
+    }
+    return n;
+}
+
+static void flush(chip8_stream* stream)
+{
+    size_t off = 0;
+    while (off < stream->used && !stream->failed)
+    {
+        ssize_t n = write(stream->fd, stream->buf + off, stream->used - off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            stream->failed = 1;
+        else
+            off += n;
+    }
+    stream->stats.bytes += off;
+    stream->used = 0;
+    stream->sinceFlush = 0;
+}
+
+chip8_stream* streamOpen(int fd, int own)
+{
+    chip8_stream* stream = calloc(1, sizeof(chip8_stream));
+    unsigned char* buf = malloc(STREAM_BUFFER);
+    if (stream == NULL || buf == NULL || fd < 0)
+    {
+        free(stream);
+        free(buf);
+        return NULL;
+    }
+    stream->fd = fd;
+    stream->own = own;
+    stream->buf = buf;
+    memcpy(buf, STREAM_MAGIC, 4);
+    for (int i = 0; i < 4; i++)
+        buf[4 + i] = (unsigned char)(STREAM_VERSION >> (8 * i));
+    stream->used = 8;
+    return stream;
+}
+
+chip8_stream* streamCreate(const char* path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return NULL;
+    chip8_stream* stream = streamOpen(fd, 1);
+    if (stream == NULL)
+        close(fd);
+    return stream;
+}
+
+void streamFrame(chip8_stream* stream, const chip8_state* state)
+{
+    stream->stats.frames++;
+    stream->sinceFlush++;
+    if (state->hires == stream->mode && !memcmp(state->display, stream->prev, sizeof(stream->prev)))
+    {
+        stream->pending++;
+        if (stream->sinceFlush >= STREAM_FLUSH_FRAMES && stream->used)
+            flush(stream);
+        return;
+    }
+
+    unsigned char* p = stream->buf + stream->used;
+    p += putVarint(p, stream->pending);
+    *p++ = stream->mode = state->hires;
+    int cursor = 0;
+    for (int r = 0; r < STREAM_ROWS; )
+    {
+        if (!rowChanged(stream, state, r))
+        {
+            r++;
+            continue;
+        }
+        int start = r;
+        while (r < STREAM_ROWS && rowChanged(stream, state, r))
+            r++;
+        p += putVarint(p, start - cursor + 1);
+        p += putVarint(p, r - start);
+        for (int k = start; k < r; k++)
+        {
+            unsigned char cur[STREAM_ROW_BYTES], ref[STREAM_ROW_BYTES];
+            rowBytes(state->display, k, cur);
+            rowBytes(stream->prev, k, ref);
+            p += encodeRow(cur, ref, p);
+        }
+        cursor = r;
+    }
+    *p++ = 0;
+    memcpy(stream->prev, state->display, sizeof(stream->prev));
+    stream->used = p - stream->buf;
+    stream->pending = 0;
+    stream->stats.changed++;
+    if (stream->used > STREAM_BUFFER - MAX_RECORD || stream->sinceFlush >= STREAM_FLUSH_FRAMES)
+        flush(stream);
+}
+
+int streamClose(chip8_stream* stream, stream_stats* stats)
+{
+    unsigned char* p = stream->buf + stream->used;
+    p += putVarint(p, stream->pending);
+    *p++ = STREAM_END;
+    stream->used = p - stream->buf;
+    flush(stream);
+    if (stream->own && close(stream->fd) != 0)
+        stream->failed = 1;
+    int status = stream->failed ? -1 : 0;
+    if (stats)
+        *stats = stream->stats;
+    free(stream->buf);
+    free(stream);
+    return status;
+}
+
+struct chip8_stream_reader
+{
+    FILE* in;
+    long long frame; // frames decoded so far
+    int done;
+    unsigned char mode;
+    uint64_t display[DISPLAY_PLANES][DISPLAY_WORDS][DISPLAY_HIRES_H]; // image of the last record
+    long long shown; // frames showing it not yet returned
+    unsigned char nextMode;
+    uint64_t next[DISPLAY_PLANES][DISPLAY_WORDS][DISPLAY_HIRES_H]; // decoded ahead of its turn
+    int haveNext;
+};
+
+// -1 at the end of the file or for a varint that does not fit
+static long long getVarint(FILE* in)
+{
+    unsigned long long value = 0;
+    int c;
+    for (int shift = 0; shift < 63; shift += 7)
+    {
+        if ((c = getc(in)) == EOF)
+            return -1;
+        value |= (unsigned long long)(c & 0x7F) << shift;
+        if (!(c & 0x80))
+            return (long long) value;
+    }
+    return -1;
+}
+
+chip8_stream_reader* streamReaderOpen(const char* path)
+{
+    FILE* in = fopen(path, "rb");
+    if (in == NULL)
+        return NULL;
+    unsigned char header[8];
+    chip8_stream_reader* reader = calloc(1, sizeof(chip8_stream_reader));
+    if (reader == NULL || fread(header, 1, 8, in) != 8 || memcmp(header, STREAM_MAGIC, 4)
+        || (header[4] | header[5] << 8 | header[6] << 16 | (uint32_t) header[7] << 24) != STREAM_VERSION)
+    {
+        free(reader);
+        fclose(in);
+        return NULL;
+    }
+    reader->in = in;
+    return reader;
+}
+
+void streamReaderClose(chip8_stream_reader* reader)
+{
+    fclose(reader->in);
+    free(reader);
+}
+
+// apply the changed rows of one record to next, 0 if they do not decode
+static int readRows(chip8_stream_reader* reader)
+{
+    FILE* in = reader->in;
+    int cursor = 0;
+    long long skip;
+    while ((skip = getVarint(in)) != 0)
+    {
+        long long count = getVarint(in);
+        if (skip < 0 || count <= 0 || cursor + (skip - 1) + count > STREAM_ROWS)
+            return 0;
+        cursor += skip - 1;
+        for (int r = cursor; r < cursor + count; r++)
+        {
+            unsigned char delta[STREAM_ROW_BYTES];
+            int i = 0;
+            while (i < STREAM_ROW_BYTES)
+            {
+                long long zeros = getVarint(in);
+                long long literal = getVarint(in);
+                if (zeros < 0 || literal < 0 || i + zeros + literal > STREAM_ROW_BYTES || (zeros == 0 && literal == 0))
+                    return 0;
+                memset(delta + i, 0, zeros);
+                i += zeros;
+                if (fread(delta + i, 1, literal, in) != (size_t) literal)
+                    return 0;
+                i += literal;
+            }
+            int plane = r / DISPLAY_HIRES_H;
+            int row = r % DISPLAY_HIRES_H;
+            for (int w = 0; w < DISPLAY_WORDS; w++)
+            {
+                uint64_t word = 0;
+                for (int b = 0; b < 8; b++)
+                    word = (word << 8) | delta[8 * w + b];
+                reader->next[plane][w][row] ^= word;
+            }
+        }
+        cursor += count;
+    }
+    return 1;
+}
+
+int streamRead(chip8_stream_reader* reader, stream_frame* out)
+{
+    // the image of a record runs until the next record, whose repeat count comes first
+    while (!reader->done)
+    {
+        if (reader->haveNext)
+        {
+            reader->mode = reader->nextMode;
+            memcpy(reader->display, reader->next, sizeof(reader->display));
+            reader->shown = 1;
+            reader->haveNext = 0;
+        }
+        long long repeats = getVarint(reader->in);
+        int mode = getc(reader->in);
+        if (repeats < 0 || mode == EOF)
+            return -1;
+        reader->shown += repeats;
+        if (mode == STREAM_END)
+            reader->done = 1;
+        else
+        {
+            if ((mode & ~1) != 0)
+                return -1;
+            memcpy(reader->next, reader->display, sizeof(reader->next));
+            reader->nextMode = (unsigned char) mode;
+            if (!readRows(reader))
+                return -1;
+            reader->haveNext = 1;
+        }
+        if (reader->shown > 0)
+        {
+            out->index = reader->frame;
+            out->count = reader->shown;
+            out->hires = reader->mode;
+            memcpy(out->display, reader->display, sizeof(out->display));
+            reader->frame += reader->shown;
+            reader->shown = 0;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// plane bits of the pixel at column x, row y
+static int framePixel(const stream_frame* frame, int x, int y)
+{
+    return (int)((frame->display[0][x >> 6][y] >> (63 - (x & 63))) & 1)
+        | (int)(((frame->display[1][x >> 6][y] >> (63 - (x & 63))) & 1) << 1);
+}
+
+static void writePgm(FILE* out, const stream_frame* frame)
+{
+    // plane 0 white, plane 1 dark grey, both light grey
+    static const unsigned char shades[4] = { 0, 255, 85, 170 };
+    int width = frame->hires ? DISPLAY_HIRES_W : DISPLAY_W;
+    int height = frame->hires ? DISPLAY_HIRES_H : DISPLAY_H;
+    unsigned char line[DISPLAY_HIRES_W];
+    fprintf(out, "P5\n%d %d\n255\n", width, height);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+            line[x] = shades[framePixel(frame, x, y)];
+        fwrite(line, 1, width, out);
+    }
+}
+
+// GIF output: every frame on a 128x64 canvas, lores pixels doubled, four colours
+typedef struct gif_writer
+{
+    FILE* out;
+    unsigned char block[255]; // data sub-block being filled
+    int blockLen;
+    uint32_t bits; // pending code bits, lowest first
+    int bitCount;
+    uint16_t child[4096][4]; // LZW trie, 0 where no entry
+} gif_writer;
+
+static void gifByte(gif_writer* gif, unsigned char b)
+{
+    gif->block[gif->blockLen++] = b;
+    if (gif->blockLen == 255)
+    {
+        fputc(255, gif->out);
+        fwrite(gif->block, 1, 255, gif->out);
+        gif->blockLen = 0;
+    }
+}
+
+static void gifCode(gif_writer* gif, int code, int size)
+{
+    gif->bits |= (uint32_t) code << gif->bitCount;
+    gif->bitCount += size;
+    while (gif->bitCount >= 8)
+    {
+        gifByte(gif, gif->bits & 0xFF);
+        gif->bits >>= 8;
+        gif->bitCount -= 8;
+    }
+}
+
+static void gifLe16(FILE* out, int value)
+{
+    fputc(value & 0xFF, out);
+    fputc((value >> 8) & 0xFF, out);
+}
+
+static void gifHeader(gif_writer* gif)
+{
+    static const unsigned char palette[12] = { 0, 0, 0, 255, 255, 255, 85, 85, 85, 170, 170, 170 };
+    fwrite("GIF89a", 1, 6, gif->out);
+    gifLe16(gif->out, DISPLAY_HIRES_W);
+    gifLe16(gif->out, DISPLAY_HIRES_H);
+    fputc(0xF1, gif->out); // global table of 4 colours
+    fputc(0, gif->out);
+    fputc(0, gif->out);
+    fwrite(palette, 1, sizeof(palette), gif->out);
+    // loop forever
+    fwrite("\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00", 1, 19, gif->out);
+}
+
+// one image shown for delay hundredths of a second, LZW coded with 2 bit pixels
+static void gifImage(gif_writer* gif, const stream_frame* frame, int delay)
+{
+    FILE* out = gif->out;
+    fwrite("\x21\xF9\x04\x00", 1, 4, out);
+    gifLe16(out, delay);
+    fwrite("\x00\x00", 1, 2, out);
+    fputc(0x2C, out);
+    gifLe16(out, 0);
+    gifLe16(out, 0);
+    gifLe16(out, DISPLAY_HIRES_W);
+    gifLe16(out, DISPLAY_HIRES_H);
+    fputc(0, out);
+    fputc(2, out); // minimum code size
+
+    enum { CLEAR = 4, EOI = 5, FIRST = 6 };
+    int size = 3;
+    int next = FIRST;
+    int prefix = -1;
+    int scale = frame->hires ? 1 : 2;
+    memset(gif->child, 0, sizeof(gif->child));
+    gif->blockLen = 0;
+    gif->bits = 0;
+    gif->bitCount = 0;
+    gifCode(gif, CLEAR, size);
+    for (int y = 0; y < DISPLAY_HIRES_H; y++)
+    {
+        for (int x = 0; x < DISPLAY_HIRES_W; x++)
+        {
+            int pixel = framePixel(frame, x / scale, y / scale);
+            if (prefix < 0)
+            {
+                prefix = pixel;
+                continue;
+            }
+            if (gif->child[prefix][pixel])
+            {
+                prefix = gif->child[prefix][pixel];
+                continue;
+            }
+            gifCode(gif, prefix, size);
+            if (next < 4096)
+            {
+                if (next == (1 << size))
+                    size++;
+                gif->child[prefix][pixel] = next++;
+            }
+            else
+            {
+                // table full, start over
+                gifCode(gif, CLEAR, size);
+                memset(gif->child, 0, sizeof(gif->child));
+                size = 3;
+                next = FIRST;
+            }
+            prefix = pixel;
+        }
+    }
+    gifCode(gif, prefix, size);
+    gifCode(gif, EOI, size);
+    if (gif->bitCount)
+        gifByte(gif, gif->bits & 0xFF);
+    if (gif->blockLen)
+    {
+        fputc(gif->blockLen, out);
+        fwrite(gif->block, 1, gif->blockLen, out);
+    }
+    fputc(0, out);
+}
+
+// 1 if name holds one frame number conversion, a %d with at most a 0 flag and a width,
+// 0 if it holds no % at all, -1 for anything else, which must not reach snprintf as a format
+static int framePattern(const char* name)
+{
+    const char* p = strchr(name, '%');
+    if (p == NULL)
+        return 0;
+    p++;
+    if (*p == '0')
+        p++;
+    for (int digits = 0; *p >= '0' && *p <= '9'; digits++, p++)
+    {
+        if (digits == 3)
+            return -1;
+    }
+    if (*p != 'd' || strchr(p, '%') != NULL)
+        return -1;
+    return 1;
+}
+
+int streamConvert(const char* path, const char* outName, long long first, long long count, long long* written)
+{
+    *written = 0;
+    size_t len = strlen(outName);
+    int gif = len >= 4 && !strcmp(outName + len - 4, ".gif");
+    int perFrame = gif ? 0 : framePattern(outName);
+    if (perFrame < 0)
+        return -1;
+    chip8_stream_reader* reader = streamReaderOpen(path);
+    if (reader == NULL)
+        return -1;
+    FILE* out = NULL;
+    gif_writer* writer = gif ? malloc(sizeof(gif_writer)) : NULL;
+    stream_frame* frame = malloc(sizeof(stream_frame));
+    if (frame == NULL || (gif && writer == NULL) || (!perFrame && (out = fopen(outName, "wb")) == NULL))
+    {
+        free(writer);
+        free(frame);
+        streamReaderClose(reader);
+        return -1;
+    }
+    if (writer)
+    {
+        writer->out = out;
+        gifHeader(writer);
+    }
+
+    long long end = count < 0 ? -1 : first + count;
+    int status = 0;
+    int got;
+    while ((got = streamRead(reader, frame)) > 0)
+    {
+        // the part of this image's frames inside the range
+        long long from = frame->index > first ? frame->index : first;
+        long long to = frame->index + frame->count;
+        if (end >= 0 && to > end)
+            to = end;
+        if (from < to && writer)
+        {
+            // 60Hz in hundredths, rounded on the running total so delays do not drift
+            int delay = (int)((to - first) * 100 / 60 - (from - first) * 100 / 60);
+            gifImage(writer, frame, delay);
+        }
+        for (long long f = from; f < to && !writer; f++)
+        {
+            if (perFrame)
+            {
+                char name[4096];
+                FILE* one = NULL;
+                if (snprintf(name, sizeof(name), outName, (int) f) < (int) sizeof(name))
+                    one = fopen(name, "wb");
+                if (one == NULL)
+                {
+                    status = -1;
+                    break;
+                }
+                writePgm(one, frame);
+                if (ferror(one) | fclose(one))
+                    status = -1;
+            }
+            else
+                writePgm(out, frame);
+        }
+        if (status < 0)
+            break;
+        if (from < to)
+            *written += to - from;
+        if (end >= 0 && frame->index + frame->count >= end)
+            break;
+    }
+    if (got < 0)
+        status = -2;
+    if (writer)
+    {
+        // a truncated stream still leaves a GIF that ends properly
+        fputc(0x3B, out);
+        free(writer);
+    }
+    if (out && (ferror(out) | fclose(out)))
+        status = -1;
+    free(frame);
+    streamReaderClose(reader);
+    return status;
+}
@@ -0,0 +1,75 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+#define STREAM_MAGIC "C8FS"
+#define STREAM_VERSION 1
+#define STREAM_BUFFER 65536 // encoded frames collected before a write
+#define STREAM_FLUSH_FRAMES 60 // frames between writes, so a reader on a pipe sees each second
+
+// frame stream: the display at every 60Hz timer tick while state->stream is set, for
+// headless and batch runs with no terminal. a frame the same as the one before costs
+// nothing but a count, others store only the rows that changed, XORed with the previous
+// frame's and run length encoded.
+//
+// file: magic, then the version as 4 bytes little endian, then records. a record is a
+// varint count of frames that repeated the previous one, the mode byte (bit 0 hires),
+// then runs of changed rows: varint 1 + rows unchanged since the last run, varint rows
+// in the run, and for each of them its 16 bytes (plane 0 rows 0-63, then plane 1, each
+// column 0 first and bit 7 leftmost) XOR the previous frame's as alternating varint zero
+// run, varint literal count and literal bytes until all 16 are covered. a 0 in place of
+// a run ends the record. the stream ends with the repeat count and a 0xFF mode byte.
+
+#define STREAM_ROWS (DISPLAY_PLANES * DISPLAY_HIRES_H)
+#define STREAM_ROW_BYTES (DISPLAY_WORDS * 8)
+#define STREAM_END 0xFF
+
+typedef struct chip8_stream chip8_stream;
+
+typedef struct stream_stats
+{
+    long long frames;
+    long long changed; // frames that differed from the one before
+    long long bytes; // written, header included
+} stream_stats;
+
+// start streaming to fd, which is closed with the stream if own is set. NULL if it
+// cannot be allocated. the caller sets state->stream to it
+chip8_stream* streamOpen(int fd, int own);
+// same to a file created at path, NULL if it cannot be written
+chip8_stream* streamCreate(const char* path);
+// the display at the end of one frame, called by chip8TickTimers
+void streamFrame(chip8_stream* stream, const chip8_state* state);
+// write the end marker and what is buffered, and close. fills stats if given, -1 on write errors
+int streamClose(chip8_stream* stream, stream_stats* stats);
+
+// a decoded image and how many frames in a row show it
+typedef struct stream_frame
+{
+    long long index; // first frame showing it
+    long long count;
+    unsigned char hires;
+    uint64_t display[DISPLAY_PLANES][DISPLAY_WORDS][DISPLAY_HIRES_H]; // as in chip8_state
+} stream_frame;
+
+typedef struct chip8_stream_reader chip8_stream_reader;
+
+// NULL if path cannot be read or is not a frame stream
+chip8_stream_reader* streamReaderOpen(const char* path);
+void streamReaderClose(chip8_stream_reader* reader);
+// next image: 1, 0 at the end, -1 if the stream is truncated or corrupt
+int streamRead(chip8_stream_reader* reader, stream_frame* out);
+
+// write frames [first, first + count) of the stream at path to out: an animated GIF for a
+// .gif name, one binary PGM per frame for a name with a printf %d (the frame number,
+// optionally zero padded to a width such as %05d), otherwise every frame in one PGM stream.
+// count < 0 runs to the end. the frames written go in *written. returns 0, -1 if the name
+// holds any other % conversion or a file cannot be opened or written, or -2 if the stream
+// is truncated or corrupt, when the frames before that point are still converted
+int streamConvert(const char* path, const char* out, long long first, long long count, long long* written);
+
+#endif
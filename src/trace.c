@@ -0,0 +1,705 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "chip8.h"
+#include "trace.h"
+
+// record: a flags byte, then the parts it flags in this order
+#define TR_JUMP 0x01 // pc is not the one after the previous record: zigzag varint delta from it
+#define TR_INST 0x02 // instruction word differs from the last one recorded at pc: 2 bytes
+#define TR_REGS 0x04 // varint changed mask, new V bytes, zigzag varint I delta, varint SP, DT, ST
+#define TR_MEM 0x08 // varint count, varint address, the bytes
+#define TR_DRAW 0x10 // a DXYN
+#define TR_COLLIDE 0x20 // and it collided
+
+#define MAX_RECORD 64 // encoded size bound, a block is handed over when less is left
+#define HEADER_SIZE 29
+#define LZ_HASH_BITS 14
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 0xFFFF
+#define PACKED_MAX (2 * TRACE_BLOCK + 16) // worst case compressed block
+
+struct chip8_trace
+{
+    FILE* out;
+
+    // emulation thread
+    unsigned char* buf[2];
+    int active; // buffer being filled
+    size_t used;
+    int pending; // an instruction started and not recorded yet
+    unsigned short pc; // of the pending instruction
+    unsigned short inst;
+    unsigned short expect; // pc after the previous record
+    // registers before the pending instruction
+    unsigned char v[16];
+    unsigned short regI;
+    unsigned short sp;
+    unsigned char delayTimer;
+    unsigned char soundTimer;
+    unsigned short instCache[MEM_SIZE]; // last word recorded at each pc
+    long long records;
+    long long rawBytes;
+
+    // handed over buffers, len nonzero until the writer is done with it
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    size_t len[2];
+    int closing;
+
+    // writer thread
+    unsigned char* packed;
+    uint32_t lzTable[1 << LZ_HASH_BITS]; // position + 1 of the last 4 bytes with each hash
+    long long fileBytes;
+    int failed;
+    pthread_t thread;
+};
+
+struct chip8_trace_reader
+{
+    FILE* in;
+    unsigned char* raw;
+    unsigned char* packed;
+    size_t rawLen;
+    size_t pos;
+    trace_record regs; // registers so far
+    unsigned short expect;
+    unsigned short instCache[MEM_SIZE];
+};
+
+static size_t putVarint(unsigned char* out, uint64_t value)
+{
+    size_t n = 0;
+    while (value >= 0x80)
+    {
+        out[n++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (unsigned char) value;
+    return n;
+}
+
+static int getVarint(const unsigned char** in, const unsigned char* end, uint64_t* value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if (*in >= end)
+            return -1;
+        unsigned char b = *(*in)++;
+        *value |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            return 0;
+    }
+    return -1;
+}
+
+static uint64_t zigzag(long long value)
+{
+    return value < 0 ? ((uint64_t)(-value) << 1) - 1 : (uint64_t) value << 1;
+}
+
+static long long unzigzag(uint64_t value)
+{
+    return (value & 1) ? -(long long)((value + 1) >> 1) : (long long)(value >> 1);
+}
+
+static uint32_t read32(const unsigned char* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+// LZ77 with a single probe hash table: sequences of a varint literal count, the literals,
+// a varint match length (0 ends the block) and a varint match offset
+static size_t lzCompress(const unsigned char* in, size_t len, unsigned char* out, uint32_t* table)
+{
+    size_t o = 0;
+    size_t lit = 0;
+    size_t pos = 0;
+    memset(table, 0, sizeof(uint32_t) << LZ_HASH_BITS);
+    while (pos + LZ_MIN_MATCH <= len)
+    {
+        uint32_t seq = read32(in + pos);
+        uint32_t h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+        size_t cand = table[h];
+        table[h] = pos + 1;
+        if (cand == 0 || pos - (cand - 1) > LZ_MAX_OFFSET || read32(in + cand - 1) != seq)
+        {
+            pos++;
+            continue;
+        }
+        size_t ref = cand - 1;
+        size_t n = LZ_MIN_MATCH;
+        while (pos + n < len && in[ref + n] == in[pos + n])
+            n++;
+        o += putVarint(out + o, pos - lit);
+        memcpy(out + o, in + lit, pos - lit);
+        o += pos - lit;
+        o += putVarint(out + o, n);
+        o += putVarint(out + o, pos - ref);
+        pos += n;
+        lit = pos;
+    }
+    o += putVarint(out + o, len - lit);
+    memcpy(out + o, in + lit, len - lit);
+    o += len - lit;
+    o += putVarint(out + o, 0);
+    return o;
+}
+
+// -1 unless in decodes to exactly len bytes
+static int lzDecompress(const unsigned char* in, size_t inLen, unsigned char* out, size_t len)
+{
+    const unsigned char* end = in + inLen;
+    size_t o = 0;
+    for (;;)
+    {
+        uint64_t lits, n, offset;
+        if (getVarint(&in, end, &lits) < 0 || lits > (size_t)(end - in) || lits > len - o)
+            return -1;
+        memcpy(out + o, in, lits);
+        in += lits;
+        o += lits;
+        if (getVarint(&in, end, &n) < 0)
+            return -1;
+        if (n == 0)
+            return (o == len && in == end) ? 0 : -1;
+        if (getVarint(&in, end, &offset) < 0 || offset == 0 || offset > o || n > len - o)
+            return -1;
+        // byte at a time, matches may overlap their own output
+        for (size_t i = 0; i < n; i++, o++)
+            out[o] = out[o - offset];
+    }
+}
+
+static void writeBlock(chip8_trace* trace, const unsigned char* raw, size_t len)
+{
+    unsigned char head[20];
+    size_t packedLen = lzCompress(raw, len, trace->packed, trace->lzTable);
+    const unsigned char* body = trace->packed;
+    if (packedLen >= len)
+    {
+        // stored, which the reader tells apart by its size
+        body = raw;
+        packedLen = len;
+    }
+    size_t h = putVarint(head, len);
+    h += putVarint(head + h, packedLen);
+    if (fwrite(head, 1, h, trace->out) != h || fwrite(body, 1, packedLen, trace->out) != packedLen)
+        trace->failed = 1;
+    trace->fileBytes += h + packedLen;
+}
+
+static void* traceWriter(void* arg)
+{
+    chip8_trace* trace = arg;
+    int w = 0;
+    pthread_mutex_lock(&trace->lock);
+    for (;;)
+    {
+        while (!trace->len[w] && !trace->closing)
+            pthread_cond_wait(&trace->cond, &trace->lock);
+        // buffers are handed over alternately, so nothing is waiting behind an empty one
+        if (!trace->len[w])
+            break;
+        size_t len = trace->len[w];
+        pthread_mutex_unlock(&trace->lock);
+        writeBlock(trace, trace->buf[w], len);
+        pthread_mutex_lock(&trace->lock);
+        trace->len[w] = 0;
+        pthread_cond_broadcast(&trace->cond);
+        w ^= 1;
+    }
+    pthread_mutex_unlock(&trace->lock);
+    return NULL;
+}
+
+static void handOff(chip8_trace* trace)
+{
+    pthread_mutex_lock(&trace->lock);
+    trace->len[trace->active] = trace->used;
+    pthread_cond_broadcast(&trace->cond);
+    trace->active ^= 1;
+    // only waits when the writer is a whole block behind
+    while (trace->len[trace->active])
+        pthread_cond_wait(&trace->cond, &trace->lock);
+    pthread_mutex_unlock(&trace->lock);
+    trace->rawBytes += trace->used;
+    trace->used = 0;
+}
+
+static void snapshotRegs(chip8_trace* trace, const chip8_state* state)
+{
+    memcpy(trace->v, state->regXY, 16);
+    trace->regI = state->regI;
+    trace->sp = state->stackPointer;
+    trace->delayTimer = state->delayTimer;
+    trace->soundTimer = state->soundTimer;
+}
+
+chip8_trace* traceOpen(const char* path, const chip8_state* state)
+{
+    chip8_trace* trace = calloc(1, sizeof(chip8_trace));
+    if (trace == NULL)
+        return NULL;
+    trace->buf[0] = malloc(TRACE_BLOCK);
+    trace->buf[1] = malloc(TRACE_BLOCK);
+    trace->packed = malloc(PACKED_MAX);
+    trace->out = fopen(path, "wb");
+    if (!trace->buf[0] || !trace->buf[1] || !trace->packed || !trace->out)
+    {
+        if (trace->out)
+            fclose(trace->out);
+        free(trace->buf[0]);
+        free(trace->buf[1]);
+        free(trace->packed);
+        free(trace);
+        return NULL;
+    }
+
+    unsigned char h[HEADER_SIZE];
+    memcpy(h, TRACE_MAGIC, 4);
+    h[4] = TRACE_VERSION;
+    h[5] = state->quirks;
+    h[6] = state->pc & 0xFF;
+    h[7] = state->pc >> 8;
+    h[8] = state->regI & 0xFF;
+    h[9] = state->regI >> 8;
+    memcpy(h + 10, state->regXY, 16);
+    h[26] = state->stackPointer;
+    h[27] = state->delayTimer;
+    h[28] = state->soundTimer;
+    if (fwrite(h, 1, sizeof(h), trace->out) != sizeof(h))
+        trace->failed = 1;
+    trace->fileBytes = sizeof(h);
+    trace->expect = state->pc;
+    snapshotRegs(trace, state);
+
+    pthread_mutex_init(&trace->lock, NULL);
+    pthread_cond_init(&trace->cond, NULL);
+    if (pthread_create(&trace->thread, NULL, traceWriter, trace) != 0)
+    {
+        fclose(trace->out);
+        free(trace->buf[0]);
+        free(trace->buf[1]);
+        free(trace->packed);
+        free(trace);
+        return NULL;
+    }
+    return trace;
+}
+
+// encode the pending instruction now that it ran
+static void finish(chip8_trace* trace, const chip8_state* state)
+{
+    unsigned char* start = trace->buf[trace->active] + trace->used;
+    unsigned char* p = start + 1;
+    unsigned char flags = 0;
+    unsigned short pc = trace->pc;
+    unsigned short inst = trace->inst;
+    unsigned short before = trace->regI;
+
+    if (pc != trace->expect)
+    {
+        flags |= TR_JUMP;
+        p += putVarint(p, zigzag((long long) pc - trace->expect));
+    }
+    if (trace->instCache[pc] != inst)
+    {
+        flags |= TR_INST;
+        *p++ = inst >> 8;
+        *p++ = inst & 0xFF;
+        trace->instCache[pc] = inst;
+    }
+
+    // most instructions change one register or none, compare 8 at a time first
+    uint32_t changed = 0;
+    for (int half = 0; half < 16; half += 8)
+    {
+        uint64_t now, was;
+        memcpy(&now, state->regXY + half, 8);
+        memcpy(&was, trace->v + half, 8);
+        if (now == was)
+            continue;
+        for (int r = half; r < half + 8; r++)
+        {
+            if (state->regXY[r] != trace->v[r])
+                changed |= 1u << r;
+        }
+    }
+    if (state->regI != trace->regI)
+        changed |= TRACE_REG_I;
+    if (state->stackPointer != trace->sp)
+        changed |= TRACE_REG_SP;
+    if (state->delayTimer != trace->delayTimer)
+        changed |= TRACE_REG_DT;
+    if (state->soundTimer != trace->soundTimer)
+        changed |= TRACE_REG_ST;
+    if (changed)
+    {
+        flags |= TR_REGS;
+        p += putVarint(p, changed);
+        for (int r = 0; r < 16; r++)
+        {
+            if (changed & (1u << r))
+                *p++ = trace->v[r] = state->regXY[r];
+        }
+        if (changed & TRACE_REG_I)
+            p += putVarint(p, zigzag((long long) state->regI - trace->regI));
+        if (changed & TRACE_REG_SP)
+            p += putVarint(p, trace->sp = state->stackPointer);
+        if (changed & TRACE_REG_DT)
+            *p++ = trace->delayTimer = state->delayTimer;
+        if (changed & TRACE_REG_ST)
+            *p++ = trace->soundTimer = state->soundTimer;
+        trace->regI = state->regI;
+    }
+
+    int count = 0;
+    if ((inst & 0xF0FF) == 0xF033)
+        count = 3;
+    else if ((inst & 0xF0FF) == 0xF055)
+        count = ((inst >> 8) & 0xF) + 1;
+    if (count)
+    {
+        flags |= TR_MEM;
+        p += putVarint(p, count);
+        p += putVarint(p, before);
+        for (int k = 0; k < count; k++)
+            *p++ = state->ram[(before + k) & (MEM_SIZE-1)];
+    }
+    if ((inst & 0xF000) == 0xD000)
+        flags |= TR_DRAW | (state->regXY[0xF] ? TR_COLLIDE : 0);
+
+    *start = flags;
+    trace->used = p - trace->buf[trace->active];
+    trace->expect = pc + 2;
+    trace->records++;
+    trace->pending = 0;
+    if (trace->used > TRACE_BLOCK - MAX_RECORD)
+        handOff(trace);
+}
+
+void traceStep(chip8_trace* trace, const chip8_state* state, unsigned short pc)
+{
+    if (trace->pending)
+        finish(trace, state);
+    else
+        snapshotRegs(trace, state); // timers ticked since the last run
+    trace->pending = 1;
+    trace->pc = pc;
+    trace->inst = (state->ram[pc] << 8) | state->ram[(pc+1) & (MEM_SIZE-1)];
+}
+
+void traceEnd(chip8_trace* trace, const chip8_state* state, int status)
+{
+    if (trace->pending && status != CHIP8_FAULT)
+        finish(trace, state);
+    trace->pending = 0;
+}
+
+int traceClose(chip8_trace* trace, trace_stats* stats)
+{
+    if (trace->used)
+        handOff(trace);
+    pthread_mutex_lock(&trace->lock);
+    trace->closing = 1;
+    pthread_cond_broadcast(&trace->cond);
+    pthread_mutex_unlock(&trace->lock);
+    pthread_join(trace->thread, NULL);
+
+    unsigned char tail[12];
+    size_t n = putVarint(tail, 0);
+    n += putVarint(tail + n, trace->records);
+    if (fwrite(tail, 1, n, trace->out) != n)
+        trace->failed = 1;
+    trace->fileBytes += n;
+    if (fclose(trace->out) != 0)
+        trace->failed = 1;
+
+    if (stats)
+    {
+        stats->records = trace->records;
+        stats->rawBytes = trace->rawBytes;
+        stats->fileBytes = trace->fileBytes;
+    }
+    int result = trace->failed ? -1 : 0;
+    pthread_mutex_destroy(&trace->lock);
+    pthread_cond_destroy(&trace->cond);
+    free(trace->buf[0]);
+    free(trace->buf[1]);
+    free(trace->packed);
+    free(trace);
+    return result;
+}
+
+chip8_trace_reader* traceReaderOpen(const char* path)
+{
+    FILE* in = fopen(path, "rb");
+    if (in == NULL)
+        return NULL;
+    unsigned char h[HEADER_SIZE];
+    chip8_trace_reader* reader = calloc(1, sizeof(chip8_trace_reader));
+    if (reader == NULL || fread(h, 1, sizeof(h), in) != sizeof(h) || memcmp(h, TRACE_MAGIC, 4) || h[4] != TRACE_VERSION
+        || (reader->raw = malloc(TRACE_BLOCK)) == NULL || (reader->packed = malloc(PACKED_MAX)) == NULL)
+    {
+        if (reader)
+        {
+            free(reader->raw);
+            free(reader);
+        }
+        fclose(in);
+        return NULL;
+    }
+    reader->in = in;
+    reader->regs.pc = h[6] | (h[7] << 8);
+    reader->regs.regI = h[8] | (h[9] << 8);
+    memcpy(reader->regs.v, h + 10, 16);
+    reader->regs.sp = h[26];
+    reader->regs.delayTimer = h[27];
+    reader->regs.soundTimer = h[28];
+    reader->expect = reader->regs.pc;
+    return reader;
+}
+
+void traceReaderClose(chip8_trace_reader* reader)
+{
+    if (reader == NULL)
+        return;
+    fclose(reader->in);
+    free(reader->raw);
+    free(reader->packed);
+    free(reader);
+}
+
+static int readFileVarint(FILE* in, uint64_t* value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int c = fgetc(in);
+        if (c == EOF)
+            return -1;
+        *value |= (uint64_t)(c & 0x7F) << shift;
+        if (!(c & 0x80))
+            return 0;
+    }
+    return -1;
+}
+
+// next block into raw: 1, 0 at the end marker, -1 if corrupt
+static int readBlock(chip8_trace_reader* reader)
+{
+    uint64_t rawLen, packedLen;
+    if (readFileVarint(reader->in, &rawLen) < 0)
+        return -1;
+    if (rawLen == 0)
+    {
+        uint64_t records;
+        if (readFileVarint(reader->in, &records) < 0 || (long long) records != reader->regs.index)
+            return -1;
+        return 0;
+    }
+    if (rawLen > TRACE_BLOCK || readFileVarint(reader->in, &packedLen) < 0 || packedLen > PACKED_MAX)
+        return -1;
+    if (packedLen == rawLen)
+    {
+        if (fread(reader->raw, 1, rawLen, reader->in) != rawLen)
+            return -1;
+    }
+    else if (fread(reader->packed, 1, packedLen, reader->in) != packedLen
+        || lzDecompress(reader->packed, packedLen, reader->raw, rawLen) < 0)
+        return -1;
+    reader->rawLen = rawLen;
+    reader->pos = 0;
+    return 1;
+}
+
+int traceRead(chip8_trace_reader* reader, trace_record* out)
+{
+    if (reader->pos == reader->rawLen)
+    {
+        int got = readBlock(reader);
+        if (got <= 0)
+            return got;
+    }
+    const unsigned char* p = reader->raw + reader->pos;
+    const unsigned char* end = reader->raw + reader->rawLen;
+    trace_record* rec = &reader->regs;
+    uint64_t value;
+    unsigned char flags = *p++;
+
+    rec->pc = reader->expect;
+    if (flags & TR_JUMP)
+    {
+        if (getVarint(&p, end, &value) < 0)
+            return -1;
+        rec->pc = (reader->expect + unzigzag(value)) & 0xFFFF;
+    }
+    if (rec->pc >= MEM_SIZE)
+        return -1;
+    if (flags & TR_INST)
+    {
+        if (end - p < 2)
+            return -1;
+        reader->instCache[rec->pc] = (p[0] << 8) | p[1];
+        p += 2;
+    }
+    rec->inst = reader->instCache[rec->pc];
+
+    rec->changed = 0;
+    if (flags & TR_REGS)
+    {
+        if (getVarint(&p, end, &value) < 0 || value > 0xFFFFF)
+            return -1;
+        rec->changed = value;
+        for (int r = 0; r < 16; r++)
+        {
+            if (!(rec->changed & (1u << r)))
+                continue;
+            if (p >= end)
+                return -1;
+            rec->v[r] = *p++;
+        }
+        if (rec->changed & TRACE_REG_I)
+        {
+            if (getVarint(&p, end, &value) < 0)
+                return -1;
+            rec->regI = (rec->regI + unzigzag(value)) & 0xFFFF;
+        }
+        if (rec->changed & TRACE_REG_SP)
+        {
+            if (getVarint(&p, end, &value) < 0)
+                return -1;
+            rec->sp = value;
+        }
+        if (end - p < !!(rec->changed & TRACE_REG_DT) + !!(rec->changed & TRACE_REG_ST))
+            return -1;
+        if (rec->changed & TRACE_REG_DT)
+            rec->delayTimer = *p++;
+        if (rec->changed & TRACE_REG_ST)
+            rec->soundTimer = *p++;
+    }
+
+    rec->memCount = 0;
+    if (flags & TR_MEM)
+    {
+        uint64_t count, addr;
+        if (getVarint(&p, end, &count) < 0 || count > 16 || getVarint(&p, end, &addr) < 0 || (uint64_t)(end - p) < count)
+            return -1;
+        rec->memCount = count;
+        rec->memAddr = addr;
+        memcpy(rec->mem, p, count);
+        p += count;
+    }
+    rec->collision = (flags & TR_DRAW) ? !!(flags & TR_COLLIDE) : -1;
+
+    reader->pos = p - reader->raw;
+    reader->expect = rec->pc + 2;
+    *out = *rec;
+    rec->index++;
+    return 1;
+}
+
+void tracePrintRecord(const trace_record* rec, FILE* out)
+{
+    char text[32];
+    chip8Disassemble(rec->inst, text, sizeof(text));
+    fprintf(out, "%10lld  %03X  %04X  %-18s", rec->index, rec->pc, rec->inst, text);
+    for (int r = 0; r < 16; r++)
+    {
+        if (rec->changed & (1u << r))
+            fprintf(out, " V%X=%02X", r, rec->v[r]);
+    }
+    if (rec->changed & TRACE_REG_I)
+        fprintf(out, " I=%03X", rec->regI);
+    if (rec->changed & TRACE_REG_SP)
+        fprintf(out, " SP=%d", rec->sp);
+    if (rec->changed & TRACE_REG_DT)
+        fprintf(out, " DT=%02X", rec->delayTimer);
+    if (rec->changed & TRACE_REG_ST)
+        fprintf(out, " ST=%02X", rec->soundTimer);
+    if (rec->memCount)
+    {
+        fprintf(out, " [%03X]=", rec->memAddr);
+        for (int k = 0; k < rec->memCount; k++)
+            fprintf(out, "%02X", rec->mem[k]);
+    }
+    if (rec->collision >= 0)
+        fprintf(out, rec->collision ? " collision" : " no collision");
+    fprintf(out, "\n");
+}
+
+static int sameRecord(const trace_record* a, const trace_record* b)
+{
+    return a->pc == b->pc && a->inst == b->inst && a->changed == b->changed && !memcmp(a->v, b->v, 16)
+        && a->regI == b->regI && a->sp == b->sp && a->delayTimer == b->delayTimer && a->soundTimer == b->soundTimer
+        && a->memCount == b->memCount && (a->memCount == 0 || (a->memAddr == b->memAddr && !memcmp(a->mem, b->mem, a->memCount)))
+        && a->collision == b->collision;
+}
+
+long long traceDiff(const char* pathA, const char* pathB, FILE* out)
+{
+    chip8_trace_reader* a = traceReaderOpen(pathA);
+    chip8_trace_reader* b = traceReaderOpen(pathB);
+    if (a == NULL || b == NULL)
+    {
+        fprintf(out, "cannot read %s\n", a == NULL ? pathA : pathB);
+        traceReaderClose(a);
+        traceReaderClose(b);
+        return -2;
+    }
+
+    trace_record ra, rb, last;
+    long long index = 0;
+    long long result = -1;
+    int haveLast = 0;
+    for (;;)
+    {
+        int gotA = traceRead(a, &ra);
+        int gotB = traceRead(b, &rb);
+        if (gotA < 0 || gotB < 0)
+        {
+            fprintf(out, "%s is corrupt at instruction %lld\n", gotA < 0 ? pathA : pathB, index);
+            result = -2;
+            break;
+        }
+        if (gotA == 0 && gotB == 0)
+        {
+            fprintf(out, "traces match: %lld instructions\n", index);
+            break;
+        }
+        if (gotA && gotB && sameRecord(&ra, &rb))
+        {
+            last = ra;
+            haveLast = 1;
+            index++;
+            continue;
+        }
+
+        result = index;
+        fprintf(out, "first divergence at instruction %lld\n", index);
+        if (haveLast)
+        {
+            fprintf(out, "last common:\n  ");
+            tracePrintRecord(&last, out);
+        }
+        fprintf(out, "%s:\n  ", pathA);
+        if (gotA)
+            tracePrintRecord(&ra, out);
+        else
+            fprintf(out, "ends\n");
+        fprintf(out, "%s:\n  ", pathB);
+        if (gotB)
+            tracePrintRecord(&rb, out);
+        else
+            fprintf(out, "ends\n");
+        break;
+    }
+    traceReaderClose(a);
+    traceReaderClose(b);
+    return result;
+}
@@ -0,0 +1,83 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+#define TRACE_MAGIC "C8TR"
+#define TRACE_VERSION 1
+#define TRACE_BLOCK 65536 // record bytes compressed and written as one block
+
+// execution trace: one record per instruction the interpreter runs while state->trace is
+// set, with its pc, instruction word, the registers it changed, the bytes FX33/FX55 wrote
+// and the DXYN collision flag. records are delta and varint encoded against the previous
+// ones, collected into blocks that a background thread compresses and writes while the
+// emulation thread fills the other of two buffers. traced runs use an interpreter without
+// the wait loop fast-forward, so every instruction is in the trace.
+//
+// file: the header (magic, version, quirks, then pc, I, V0-VF, SP, DT and ST at the start),
+// blocks of varint raw size, varint stored size and the LZ compressed records (stored as
+// is when that is no smaller), and a zero raw size followed by the varint record count.
+
+typedef struct chip8_trace chip8_trace;
+
+// register bits of trace_record.changed, bit n for Vn below them
+#define TRACE_REG_I 0x10000
+#define TRACE_REG_SP 0x20000
+#define TRACE_REG_DT 0x40000
+#define TRACE_REG_ST 0x80000
+
+typedef struct trace_stats
+{
+    long long records;
+    long long rawBytes; // encoded records before compression
+    long long fileBytes;
+} trace_stats;
+
+// start tracing state to path from its current registers, NULL if it cannot be written.
+// the caller sets state->trace to it
+chip8_trace* traceOpen(const char* path, const chip8_state* state);
+// flush, stop the writer and close the file. fills stats if given, -1 on write errors
+int traceClose(chip8_trace* trace, trace_stats* stats);
+
+// hooks of the traced interpreter: before each instruction, and when a run returns with
+// status, where a CHIP8_FAULT means the last instruction stepped did not run
+void traceStep(chip8_trace* trace, const chip8_state* state, unsigned short pc);
+void traceEnd(chip8_trace* trace, const chip8_state* state, int status);
+
+// one decoded record with the registers after it. DT and ST are as last set by an
+// instruction, timer ticks are not traced
+typedef struct trace_record
+{
+    long long index; // instruction number from the start of the trace
+    unsigned short pc;
+    unsigned short inst;
+    uint32_t changed; // registers the instruction changed, bit n for Vn and TRACE_REG_*
+    unsigned char v[16];
+    unsigned short regI;
+    unsigned short sp;
+    unsigned char delayTimer;
+    unsigned char soundTimer;
+    int memCount; // bytes written by FX33/FX55 at memAddr
+    unsigned short memAddr;
+    unsigned char mem[16];
+    int collision; // VF after a DXYN, -1 for other instructions
+} trace_record;
+
+typedef struct chip8_trace_reader chip8_trace_reader;
+
+// NULL if path cannot be read or is not a trace
+chip8_trace_reader* traceReaderOpen(const char* path);
+void traceReaderClose(chip8_trace_reader* reader);
+// next record: 1, 0 at the end, -1 if the trace is truncated or corrupt
+int traceRead(chip8_trace_reader* reader, trace_record* out);
+// one line per record
+void tracePrintRecord(const trace_record* rec, FILE* out);
+
+// compare two traces record by record and report the first divergent instruction with
+// the records on both sides. returns its index, -1 if they match, -2 if either cannot be read
+long long traceDiff(const char* pathA, const char* pathB, FILE* out);
+
+#endif